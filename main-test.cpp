@@ -3,6 +3,12 @@
 #include <iostream>
 #include <math.h>
 #include <format>
+#include <random>
+#include <algorithm>
+#include <numeric>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
 
 #define ENABLE_NN_EXAMPLES
 #include "nn-example.h"
@@ -29,6 +35,59 @@ std::string get_line(std::string prefix)
 	return str;
 }
 
+// self-checks run without any dataset files, abort on the first failure
+void check(bool condition, const std::string& what)
+{
+	std::cout << (condition ? "[ok] " : "[FAILED] ") << what << std::endl;
+	if (!condition)
+		std::abort();
+}
+
+// random 28x28 images with labels, stands in for mnist
+nn::compact_dataset make_random_dataset(size_t count, unsigned int seed)
+{
+	nn::compact_dataset set(28, 28, 1, 10);
+	set.resize(count);
+
+	std::mt19937 rng(seed);
+	for (size_t i = 0; i < count; i++)
+	{
+		unsigned char* pixels = set.get_pixels(i);
+		for (size_t p = 0; p < set.sample_size(); p++)
+			pixels[p] = static_cast<unsigned char>(rng() & 0xff);
+		set.set_label(i, rng() % 10);
+	}
+
+	return set;
+}
+
+std::vector<float> copy_parameters(nn::examples::mnist_network& network)
+{
+	std::vector<nn::parameter_block> blocks;
+	network.get_parameters(blocks);
+
+	std::vector<float> values;
+	for (auto& b : blocks)
+		values.insert(values.end(), b.values, b.values + b.size);
+	return values;
+}
+
+// every element within tolerance of the reference, relative to the reference's largest magnitude (at least 1)
+bool matches(const nn::matrix& m, const nn::matrix& reference, float tolerance)
+{
+	if (m.width() != reference.width() || m.height() != reference.height())
+		return false;
+
+	float diff = 0, magnitude = 1;
+	for (size_t y = 0; y < m.height(); y++)
+		for (size_t x = 0; x < m.width(); x++)
+		{
+			diff = std::max(diff, std::abs(m.at(x, y) - reference.at(x, y)));
+			magnitude = std::max(magnitude, std::abs(reference.at(x, y)));
+		}
+	return diff <= tolerance * magnitude;
+}
+
 void mnist_train_test()
 {
 	nn::mnist_dataset set;
@@ -67,8 +126,624 @@ void mnist_train_test()
 	printf("verify: correct=%d, wrong=%d", correct, wrong);
 }
 
+void mnist_batch_train_test()
+{
+	nn::mnist_dataset set;
+	set.add_source(get_line("data-path"), get_line("label-path"));
+
+	nn::examples::mnist_network network;
+	network.init_weights(0.1, 0.9);
+
+	const size_t batch_size = 32;
+	const size_t input_size = 28 * 28, target_size = set.set[0]->get_target().size();
+
+	nn::matrix inputs(input_size, batch_size), targets(target_size, batch_size);
+
+	for (size_t first = 0; first + batch_size <= set.set.size(); first += batch_size)
+	{
+		// gather samples, one per row
+		for (size_t b = 0; b < batch_size; b++)
+		{
+			auto item = set.set[first + b];
+			item->get_data().copy_to(inputs.row(b));
+			memcpy(targets.row(b), item->get_target().data(), sizeof(float) * target_size);
+		}
+
+		network.feed_batch(inputs);
+		network.forward_and_grad_batch(targets);
+		network.backward_batch();
+		network.update_weights_batch();
+	}
+
+	int correct = 0, wrong = 0;
+	for (auto& item : set.set)
+	{
+		network.feed_data(item->get_data());
+		network.forward();
+
+		if (network.get_output().max().index == item->get_label())
+			correct++;
+		else
+			wrong++;
+	}
+
+	printf("verify(batch): correct=%d, wrong=%d", correct, wrong);
+}
+
+void mnist_parallel_train_test()
+{
+	nn::mnist_dataset set;
+	set.add_source(get_line("data-path"), get_line("label-path"));
+
+	nn::examples::mnist_network network;
+	network.init_weights(0.1, 0.9);
+
+	// shards each batch over every core (thread_pool::global())
+	nn::data_parallel_trainer<nn::examples::mnist_network> trainer(network);
+
+	// shuffled batches, gathered in the background while the trainer runs
+	nn::batch_loader loader(set, 256);
+
+	while (auto batch = loader.next())
+		trainer.train_batch(batch->inputs, batch->targets);
+
+	int correct = 0, wrong = 0;
+	for (auto& item : set.set)
+	{
+		network.feed_data(item->get_data());
+		network.forward();
+
+		if (network.get_output().max().index == item->get_label())
+			correct++;
+		else
+			wrong++;
+	}
+
+	printf("verify(parallel, %zu workers): correct=%d, wrong=%d", trainer.get_num_workers(), correct, wrong);
+}
+
+// train 2 epochs, checkpoint in the middle of the first, resume from it in a fresh network: weights must end up identical
+void checkpoint_resume_test()
+{
+	const nn::compact_dataset set = make_random_dataset(640, 1);
+	const std::string path = (std::filesystem::temp_directory_path() / "nn-resume-test.ckpt").string();
+	const size_t checkpoint_batch = 7;
+
+	nn::batch_loader::options opts;
+	opts.batch_size = 32;
+	opts.seed = 42;
+
+	auto train = [](nn::examples::mnist_network& network, const nn::batch_loader::batch* batch)
+		{
+			network.feed_batch(batch->inputs);
+			network.forward_and_grad_batch(batch->targets);
+			network.backward_batch();
+			network.update_weights_batch();
+		};
+
+	nn::examples::mnist_network original;
+	original.init_weights(-0.1f, 0.1f);
+	{
+		nn::batch_loader loader(set, opts);
+		nn::checkpoint_writer writer;
+
+		for (size_t epoch = 0; epoch < 2; epoch++)
+		{
+			if (epoch > 0)
+				loader.start_epoch();
+
+			while (auto batch = loader.next())
+			{
+				train(original, batch);
+				if (epoch == 0 && batch->index + 1 == checkpoint_batch)
+					writer.save(path, original, checkpoint_batch, loader.get_sampler_state());
+			}
+		}
+
+		check(writer.wait(), "checkpoint written");
+	}
+
+	nn::examples::mnist_network resumed;
+	resumed.init_weights(-0.1f, 0.1f);
+	{
+		nn::batch_loader loader(set, opts);
+
+		const nn::checkpoint_state state = nn::load_checkpoint(path, resumed);
+		check(state.sampler_state.batch == checkpoint_batch, "checkpoint keeps the batch position");
+		loader.set_sampler_state(state.sampler_state);
+
+		size_t trained = 0;
+		for (size_t epoch = 0; epoch < 2; epoch++)
+		{
+			if (epoch > 0)
+				loader.start_epoch();
+
+			while (auto batch = loader.next())
+			{
+				train(resumed, batch);
+				trained++;
+			}
+		}
+
+		check(trained == 2 * loader.batches_per_epoch() - checkpoint_batch, "resume skips the batches before the checkpoint");
+	}
+
+	std::filesystem::remove(path);
+
+	check(copy_parameters(original) == copy_parameters(resumed), "mid-epoch resume reproduces the weights");
+}
+
+// once every buffer exists, training must not touch the heap, whichever allocator is current
+void allocator_steady_state_test()
+{
+	const nn::compact_dataset set = make_random_dataset(256, 2);
+	const size_t batch_size = 32;
+
+	std::vector<nn::matrix> samples;
+	std::vector<nn::vector> targets;
+	for (size_t i = 0; i < set.size(); i++)
+	{
+		nn::vector sample(set.input_size()), target(set.target_size());
+		set.get_sample(i, sample.data());
+		set.get_target(i, target.data());
+
+		samples.emplace_back(28, 28);
+		samples.back().copy_from(sample.data());
+		targets.push_back(std::move(target));
+	}
+
+	std::vector<nn::matrix> batch_inputs, batch_targets;
+	for (size_t first = 0; first + batch_size <= set.size(); first += batch_size)
+	{
+		std::vector<size_t> indices(batch_size);
+		std::iota(indices.begin(), indices.end(), first);
+
+		nn::vector inputs(set.input_size() * batch_size), targets(set.target_size() * batch_size);
+		set.fill_batch(indices.data(), batch_size, inputs.data(), targets.data());
+
+		batch_inputs.emplace_back(set.input_size(), batch_size);
+		batch_inputs.back().copy_from(inputs.data());
+		batch_targets.emplace_back(set.target_size(), batch_size);
+		batch_targets.back().copy_from(targets.data());
+	}
+
+	nn::examples::mnist_network network;
+	network.init_weights(-0.1f, 0.1f);
+
+	// arena: temporaries of a step are dropped after it
+	auto train_single = [&](nn::arena_allocator* arena)
+		{
+			for (size_t i = 0; i < samples.size(); i++)
+			{
+				network.feed_data(samples[i]);
+				network.forward_and_grad(targets[i]);
+				network.backward();
+				network.update_weights();
+				if (arena)
+					arena->reset();
+			}
+		};
+
+	auto train_batch = [&](nn::arena_allocator* arena)
+		{
+			for (size_t b = 0; b < batch_inputs.size(); b++)
+			{
+				network.feed_batch(batch_inputs[b]);
+				network.forward_and_grad_batch(batch_targets[b]);
+				network.backward_batch();
+				network.update_weights_batch();
+				if (arena)
+					arena->reset();
+			}
+		};
+
+	nn::pool_allocator pool;
+	nn::arena_allocator arena;
+	const std::pair<const char*, nn::allocator*> allocators[] = { { "heap", &nn::heap_allocator::global() }, { "pool", &pool }, { "arena", &arena } };
+
+	for (auto& [name, alloc] : allocators)
+	{
+		nn::allocator_scope scope(*alloc);
+		nn::arena_allocator* reset = alloc == &arena ? &arena : nullptr;
+
+		train_single(reset); // warm-up: first use of every buffer size
+		size_t before = nn::math::buffer_allocations();
+		train_single(reset);
+		check(nn::math::buffer_allocations() == before, std::format("{}: no heap allocation in single-sample training", name));
+
+		train_batch(reset);
+		before = nn::math::buffer_allocations();
+		train_batch(reset);
+		check(nn::math::buffer_allocations() == before, std::format("{}: no heap allocation in batch training", name));
+	}
+}
+
+// drop_last = false: the short last batch is a view over the preallocated rows, epochs don't allocate
+void loader_short_batch_test()
+{
+	const nn::compact_dataset set = make_random_dataset(100, 3);
+
+	nn::batch_loader::options opts;
+	opts.batch_size = 32;
+	opts.drop_last = false;
+	opts.shuffle = false;
+
+	nn::batch_loader loader(set, opts);
+	nn::vector expected(set.input_size());
+
+	bool heights = true, rows = true, complete = true;
+	size_t allocations = 0;
+
+	for (size_t epoch = 0; epoch < 3; epoch++)
+	{
+		if (epoch > 0)
+			loader.start_epoch();
+
+		const size_t before = nn::math::buffer_allocations();
+		size_t samples = 0;
+
+		while (auto batch = loader.next())
+		{
+			heights &= batch->inputs.height() == batch->size && batch->targets.height() == batch->size;
+
+			for (size_t i = 0; i < batch->size; i++)
+			{
+				set.get_sample(samples + i, expected.data());
+				rows &= std::equal(expected.data(), expected.data() + set.input_size(), batch->inputs.row(i));
+			}
+			samples += batch->size;
+		}
+
+		complete &= samples == set.size();
+		if (epoch > 0) // the first epoch may still be warming up
+			allocations += nn::math::buffer_allocations() - before;
+	}
+
+	check(heights, "loader: batch height is the number of samples, short last batch included");
+	check(rows, "loader: batch rows hold the samples in order");
+	check(complete, "loader: every sample once per epoch");
+	check(allocations == 0, "loader: no allocation for the short last batch");
+}
+
+// training mode: replay the planner's timeline on the bound buffers, each write tags a buffer, each read checks the tag
+// forward i writes maps (and masks) of layer i, backward j reads them and the gradient of layer j+1, then writes its own
+// gradient. the update pass after backward reads the gradients of the conv2 layers and the maps they read
+void planner_training_alias_test()
+{
+	nn::hidden_layer::conv2_layer conv1(28, 28, 2, 3, 1, 1);
+	nn::hidden_layer::relu_layer relu1(28, 28, 2);
+	nn::hidden_layer::maxpool_layer pool1(14, 14, 2);
+	nn::hidden_layer::conv2_layer conv2(14, 14, 2, 3, 1, 1);
+	nn::hidden_layer::relu_layer relu2(14, 14, 2);
+	nn::hidden_layer::maxpool_layer pool2(7, 7, 2);
+	nn::hidden_layer::conv2_linear_adapter_layer adapter(7, 7, 2);
+
+	nn::memory_planner planner(nn::memory_planner::mode::training);
+	planner.add(conv1); planner.add(relu1); planner.add(pool1); planner.add(conv2); planner.add(relu2); planner.add(pool2); planner.add(adapter);
+	planner.bind();
+
+	using buffers = std::vector<nn::matrix*>;
+	auto maps = [](auto& layer) { return buffers{ &layer.get_map(0), &layer.get_map(1) }; };
+	auto gradients = [](auto& layer) { return buffers{ &layer.get_gradient(0), &layer.get_gradient(1) }; };
+
+	const std::vector<buffers> map_of = { maps(conv1), maps(relu1), maps(pool1), maps(conv2), maps(relu2), maps(pool2), {} };
+	const std::vector<buffers> mask_of = { {}, {}, gradients(pool1), {}, {}, gradients(pool2), {} };
+	const std::vector<buffers> gradient_of = { gradients(conv1), gradients(relu1), {}, gradients(conv2), gradients(relu2), {}, gradients(adapter) };
+	const size_t layers = map_of.size();
+
+	auto write = [](const buffers& list, float tag)
+		{
+			for (nn::matrix* m : list)
+				m->fill(tag);
+		};
+
+	auto intact = [](const buffers& list, float tag)
+		{
+			bool ok = true;
+			for (nn::matrix* m : list)
+				m->for_each([&ok, tag](size_t, size_t, float& num) { ok &= num == tag; });
+			return ok;
+		};
+
+	bool ok = true;
+
+	for (size_t i = 0; i < layers; i++)
+	{
+		write(map_of[i], 1.0f + i);
+		write(mask_of[i], 100.0f + i);
+	}
+
+	for (size_t j = layers; j-- > 0;)
+	{
+		ok &= intact(map_of[j], 1.0f + j) && intact(mask_of[j], 100.0f + j);
+		if (j + 1 < layers)
+			ok &= intact(gradient_of[j + 1], 200.0f + j + 1);
+		write(gradient_of[j], 200.0f + j);
+	}
+
+	// update pass: conv1 (layer 0) reads its input from outside the plan, conv2 (layer 3) reads pool1's maps
+	ok &= intact(gradient_of[0], 200.0f) && intact(gradient_of[3], 203.0f) && intact(map_of[2], 3.0f);
+
+	check(ok, "planner: training buffers hold their values until the backward and update steps read them");
+}
+
+// replay count requests with poisson arrivals at rate per second, print latency percentiles and throughput
+// conv_2d (im2col + gemm) against conv_2d_direct under every supported instruction set
+// kernals stay below min_kernal_taps, so the fft path is never taken here
+void conv_im2col_test()
+{
+	struct conv_case
+	{
+		size_t kernal, stride, padding;
+	};
+	const conv_case cases[] = { { 3, 1, 0 }, { 3, 2, 1 }, { 5, 1, 2 }, { 5, 3, 2 } };
+
+	nn::matrix src(31, 29); // odd sizes: partial tiles and padded rows
+	nn::math::rand_matrix(src, -1, 1);
+
+	for (auto target : { nn::simd::isa::scalar, nn::simd::isa::sse2, nn::simd::isa::avx2, nn::simd::isa::avx512 })
+	{
+		if (!nn::simd::isa_supported(target))
+			continue;
+		nn::simd::force_isa(target);
+
+		bool single = true, multi = true;
+		for (const conv_case& c : cases)
+		{
+			const size_t out_w = (src.width() - c.kernal + c.padding * 2 + 1) / c.stride;
+			const size_t out_h = (src.height() - c.kernal + c.padding * 2 + 1) / c.stride;
+
+			std::vector<nn::matrix> kernals, dst, reference;
+			for (size_t i = 0; i < 3; i++)
+			{
+				kernals.emplace_back(c.kernal, c.kernal);
+				nn::math::rand_matrix(kernals.back(), -1, 1);
+				dst.emplace_back(out_w, out_h);
+				reference.emplace_back(out_w, out_h);
+				nn::math::conv_2d_direct(reference.back(), src, kernals.back(), c.stride, c.padding);
+			}
+
+			single &= matches(nn::math::conv_2d(src, kernals[0], c.stride, c.padding), reference[0], 1e-4f);
+
+			nn::math::conv_2d(dst, src, kernals, c.stride, c.padding);
+			for (size_t i = 0; i < dst.size(); i++)
+				multi &= matches(dst[i], reference[i], 1e-4f);
+		}
+
+		check(single, std::format("conv: im2col matches direct, one kernal ({})", nn::simd::isa_name(target)));
+		check(multi, std::format("conv: im2col matches direct, many kernals ({})", nn::simd::isa_name(target)));
+	}
+
+	nn::simd::force_isa(nn::simd::detect_isa());
+}
+
+// conv_2d_winograd (one and many kernals) against conv_2d_direct under every supported instruction set,
+// then conv2_layer has to pick up kernal changes made through rand_weights and get_kernal
+void winograd_test()
+{
+	nn::matrix src(17, 13); // odd sizes: partial 2x2 output tiles
+	nn::math::rand_matrix(src, -1, 1);
+
+	std::vector<nn::matrix> kernals(3, nn::matrix(3, 3));
+	std::vector<float> transformed(kernals.size() * nn::math::winograd_kernal_floats);
+	for (size_t i = 0; i < kernals.size(); i++)
+	{
+		nn::math::rand_matrix(kernals[i], -1, 1);
+		nn::math::winograd_transform_kernal(kernals[i], transformed.data() + i * nn::math::winograd_kernal_floats);
+	}
+
+	for (auto target : { nn::simd::isa::scalar, nn::simd::isa::sse2, nn::simd::isa::avx2, nn::simd::isa::avx512 })
+	{
+		if (!nn::simd::isa_supported(target))
+			continue;
+		nn::simd::force_isa(target);
+
+		bool single = true, multi = true;
+		for (size_t padding : { 0, 1 })
+		{
+			const size_t out_w = src.width() - 2 + padding * 2, out_h = src.height() - 2 + padding * 2;
+
+			std::vector<nn::matrix> dst(kernals.size(), nn::matrix(out_w, out_h)), reference = dst;
+			for (size_t i = 0; i < kernals.size(); i++)
+				nn::math::conv_2d_direct(reference[i], src, kernals[i], 1, padding);
+
+			nn::matrix one(out_w, out_h);
+			nn::math::conv_2d_winograd(one, src, transformed.data(), padding);
+			single &= matches(one, reference[0], 1e-4f);
+
+			nn::math::conv_2d_winograd(dst, src, transformed.data(), padding);
+			for (size_t i = 0; i < dst.size(); i++)
+				multi &= matches(dst[i], reference[i], 1e-4f);
+		}
+
+		check(single, std::format("conv: winograd matches direct, one kernal ({})", nn::simd::isa_name(target)));
+		check(multi, std::format("conv: winograd matches direct, many kernals ({})", nn::simd::isa_name(target)));
+	}
+
+	nn::simd::force_isa(nn::simd::detect_isa());
+
+	// the layer caches transformed kernals; every forward below has to match the kernals it holds right now
+	nn::input_layer::matrix_input input(12, 12);
+	nn::matrix image(12, 12);
+	nn::math::rand_matrix(image, -1, 1);
+	input.push_input(image);
+
+	nn::hidden_layer::conv2_layer conv(12, 12, 2, 3, 1, 1);
+
+	// kernals are read through references taken up front: calling get_kernal would invalidate the cache by itself
+	std::vector<const nn::matrix*> kernal_refs;
+	for (size_t i = 0; i < conv.depth; i++)
+		kernal_refs.push_back(&conv.get_kernal(i));
+
+	auto forward_matches = [&]()
+		{
+			conv.forward(&input);
+
+			bool ok = true;
+			for (size_t i = 0; i < conv.depth; i++)
+			{
+				nn::matrix reference(12, 12);
+				nn::math::conv_2d_direct(reference, input.get_input(), *kernal_refs[i], 1, 1);
+				reference += conv.get_bias(i);
+				ok &= matches(conv.get_map(i), reference, 1e-4f);
+			}
+			return ok;
+		};
+
+	conv.rand_weights(-1, 1); // kernals are uninitialized memory until then
+	bool ok = forward_matches();
+	const nn::matrix before = conv.get_map(0);
+
+	conv.rand_weights(-1, 1);
+	ok &= forward_matches() && !matches(conv.get_map(0), before, 1e-4f);
+	check(ok, "conv: layer forward follows rand_weights");
+
+	const nn::matrix randomized = conv.get_map(0);
+
+	conv.get_kernal(0).at(1, 1) += 1;
+	ok &= forward_matches() && !matches(conv.get_map(0), randomized, 1e-4f);
+	check(ok, "conv: layer forward follows kernals edited through get_kernal");
+}
+
+// conv_2d_fft against conv_2d_direct, directly and through the automatic switch in conv_2d,
+// then a kernal edited in place (same address) must not be served from the spectrum cache
+void fft_test()
+{
+	nn::matrix src(64, 64);
+	nn::math::rand_matrix(src, -1, 1);
+
+	auto convolved = [&src](const nn::matrix& kernal, size_t stride, size_t padding)
+		{
+			return nn::matrix((src.width() - kernal.width() + padding * 2 + 1) / stride, (src.height() - kernal.height() + padding * 2 + 1) / stride);
+		};
+
+	nn::matrix kernal(11, 11);
+	nn::math::rand_matrix(kernal, -1, 1);
+
+	bool ok = true;
+	for (size_t stride : { 1, 2 })
+		for (size_t padding : { 0, 5 })
+		{
+			nn::matrix dst = convolved(kernal, stride, padding), reference = dst;
+			nn::math::conv_2d_direct(reference, src, kernal, stride, padding);
+			nn::math::conv_2d_fft(dst, src, kernal, stride, padding);
+			ok &= matches(dst, reference, 1e-3f);
+		}
+	check(ok, "conv: fft matches direct");
+
+	// 21x21 taps over a 64x64 output is well past the break-even point, conv_2d takes the fft path
+	nn::matrix large(21, 21);
+	nn::math::rand_matrix(large, -1, 1);
+
+	nn::matrix automatic = convolved(large, 1, 10), reference = automatic;
+	nn::math::conv_2d_direct(reference, src, large, 1, 10);
+	nn::math::conv_2d(automatic, src, large, 1, 10);
+	check(matches(automatic, reference, 1e-3f), "conv: conv_2d with a large kernal matches direct");
+
+	// the spectrum of `large` is cached now, keyed by its address; the content hash has to catch the edit
+	large.at(3, 4) += 1;
+	nn::matrix edited = convolved(large, 1, 10);
+	nn::math::conv_2d_direct(reference, src, large, 1, 10);
+	nn::math::conv_2d_fft(edited, src, large, 1, 10);
+	check(matches(edited, reference, 1e-3f) && !matches(edited, automatic, 1e-3f), "conv: fft follows a kernal edited in place");
+}
+
+void replay_requests(const nn::inference_engine& engine, nn::batch_scheduler::options opts, const std::vector<nn::vector>& samples, double rate, size_t count)
+{
+	using clock = std::chrono::steady_clock;
+
+	std::vector<clock::time_point> sent(count), done(count);
+	std::vector<std::future<nn::vector>> results(count);
+	std::vector<double> latency(count);
+	std::atomic<size_t> submitted{ 0 };
+
+	std::mt19937_64 random(1);
+	std::exponential_distribution<double> gap(rate);
+
+	{
+		nn::batch_scheduler scheduler(engine, opts);
+
+		// answers are waited for in order, batches complete in arrival order too
+		std::thread collector([&]()
+			{
+				for (size_t i = 0; i < count; i++)
+				{
+					while (submitted.load(std::memory_order_acquire) <= i)
+						std::this_thread::yield();
+
+					results[i].get();
+					done[i] = clock::now();
+				}
+			});
+
+		clock::time_point next = clock::now();
+		for (size_t i = 0; i < count; i++)
+		{
+			next += std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(gap(random)));
+			std::this_thread::sleep_until(next);
+
+			sent[i] = clock::now();
+			results[i] = scheduler.submit(samples[i % samples.size()]);
+			submitted.store(i + 1, std::memory_order_release);
+		}
+
+		collector.join();
+
+		auto stats = scheduler.get_stats();
+		printf("max_batch=%zu, max_delay=%lldus: average batch %.1f, ", opts.max_batch, static_cast<long long>(opts.max_delay.count()), double(stats.requests) / stats.batches);
+	}
+
+	for (size_t i = 0; i < count; i++)
+		latency[i] = std::chrono::duration<double, std::micro>(done[i] - sent[i]).count();
+
+	std::sort(latency.begin(), latency.end());
+	const double seconds = std::chrono::duration<double>(done[count - 1] - sent[0]).count();
+
+	printf("p50=%.0fus, p99=%.0fus, qps=%.0f\n", latency[count / 2], latency[count * 99 / 100], count / seconds);
+}
+
+void inference_batching_benchmark()
+{
+	const std::string data_path = get_line("data-path"), label_path = get_line("label-path");
+	nn::mapped_mnist_dataset set(data_path, label_path);
+
+	nn::examples::mnist_network network;
+	network.init_weights(-0.1, 0.1); // latency doesn't depend on the weights
+
+	const nn::inference_engine engine = network.compile();
+
+	std::vector<nn::vector> samples;
+	for (size_t i = 0; i < std::min<size_t>(set.size(), 1000); i++)
+	{
+		samples.emplace_back(set.input_size());
+		set.get_sample(i, samples.back().data());
+	}
+
+	double rate;
+	get_input_number("requests-per-second", rate);
+
+	nn::batch_scheduler::options single;
+	single.max_batch = 1;
+	single.max_delay = std::chrono::microseconds(0);
+
+	nn::batch_scheduler::options batched;
+	batched.max_batch = 32;
+	batched.max_delay = std::chrono::microseconds(500);
+
+	replay_requests(engine, single, samples, rate, 20000);
+	replay_requests(engine, batched, samples, rate, 20000);
+}
+
 int main()
 {
+	checkpoint_resume_test();
+	allocator_steady_state_test();
+	loader_short_batch_test();
+	planner_training_alias_test();
+	conv_im2col_test();
+	winograd_test();
+	fft_test();
+
 	nn::mnist_dataset set;
 	set.add_source(get_line("data-path"), get_line("label-path"));
 
@@ -1,7 +1,20 @@
 #include "nn-activate-function.h"
+#include "nn-simd.h"
 
 #include <math.h>
 
+void nn::activate_func::forward(const float* in, float* out, size_t n) const
+{
+	for (size_t i = 0; i < n; i++)
+		out[i] = forward(in[i]);
+}
+
+void nn::activate_func::backward(const float* in, float* out, size_t n) const
+{
+	for (size_t i = 0; i < n; i++)
+		out[i] = backward(in[i]);
+}
+
 float nn::relu_func::forward(float x) const
 {
 	return x > 0 ? x : 0.0f;
@@ -12,6 +25,16 @@ float nn::relu_func::backward(float x) const
 	return x > 0 ? 1.0f : 0.0f;
 }
 
+void nn::relu_func::forward(const float* in, float* out, size_t n) const
+{
+	simd::kernels().relu(in, out, 0.0f, n);
+}
+
+void nn::relu_func::backward(const float* in, float* out, size_t n) const
+{
+	simd::kernels().relu_backward(in, out, 0.0f, n);
+}
+
 float nn::leaky_relu_func::forward(float x) const
 {
 	return x > 0 ? x : 0.1f * x;
@@ -22,6 +45,16 @@ float nn::leaky_relu_func::backward(float x) const
 	return x > 0 ? 1.0f : 0.1f;
 }
 
+void nn::leaky_relu_func::forward(const float* in, float* out, size_t n) const
+{
+	simd::kernels().relu(in, out, 0.1f, n);
+}
+
+void nn::leaky_relu_func::backward(const float* in, float* out, size_t n) const
+{
+	simd::kernels().relu_backward(in, out, 0.1f, n);
+}
+
 float nn::sigmoid_func::forward(float x) const
 {
 	return 1.0f / (1.0f + expf(-x));
@@ -30,4 +63,15 @@ float nn::sigmoid_func::forward(float x) const
 float nn::sigmoid_func::backward(float x) const
 {
 	return x * (1.0f - x);
-}
\ No newline at end of file
+}
+
+void nn::sigmoid_func::forward(const float* in, float* out, size_t n) const
+{
+	simd::kernels().sigmoid(in, out, n);
+}
+
+void nn::sigmoid_func::backward(const float* in, float* out, size_t n) const
+{
+	for (size_t i = 0; i < n; i++)
+		out[i] = in[i] * (1.0f - in[i]);
+}
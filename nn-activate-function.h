@@ -5,6 +5,8 @@
 #ifndef NN_ACTIVATE_FUNCTION_H
 #define NN_ACTIVATE_FUNCTION_H
 
+#include <cstddef>
+
 namespace nn
 {
 	class activate_func
@@ -12,6 +14,11 @@ namespace nn
 	public:
 		virtual float forward(float x) const = 0;
 		virtual float backward(float x) const = 0;
+
+		// whole span at once, in and out may alias. defaults call the per-element versions
+		// backward takes activated values (like the per-element one) and writes the derivatives
+		virtual void forward(const float* in, float* out, size_t n) const;
+		virtual void backward(const float* in, float* out, size_t n) const;
 	};
 
 	class relu_func :public activate_func
@@ -20,6 +27,8 @@ namespace nn
 		relu_func() {};
 		float forward(float x) const;
 		float backward(float x) const;
+		void forward(const float* in, float* out, size_t n) const; // SIMD
+		void backward(const float* in, float* out, size_t n) const; // SIMD
 	};
 
 	class leaky_relu_func :public activate_func
@@ -28,6 +37,8 @@ namespace nn
 		leaky_relu_func(){}
 		float forward(float x) const;
 		float backward(float x) const;
+		void forward(const float* in, float* out, size_t n) const; // SIMD
+		void backward(const float* in, float* out, size_t n) const; // SIMD
 	};
 
 	class sigmoid_func :public activate_func
@@ -36,6 +47,8 @@ namespace nn
 		sigmoid_func(){}
 		float forward(float x) const;
 		float backward(float x) const;
+		void forward(const float* in, float* out, size_t n) const; // SIMD
+		void backward(const float* in, float* out, size_t n) const; // SIMD
 	};
 }
 
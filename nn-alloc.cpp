@@ -0,0 +1,181 @@
+#include "nn-alloc.h"
+#include "nn-math.h"
+
+#include <bit>
+#include <algorithm>
+
+//== allocator helper functions, local
+
+namespace alloc_helper
+{
+	constexpr size_t align_floats = nn::math::buffer_alignment / sizeof(float);
+	constexpr size_t min_class_floats = 16; // smallest pool size class
+
+	thread_local nn::allocator* current = nullptr;
+
+	size_t align(size_t num)
+	{
+		return (num + align_floats - 1) / align_floats * align_floats;
+	}
+}
+
+float* nn::heap_allocator::allocate(size_t num)
+{
+	return math::alloc_buffer(num);
+}
+
+void nn::heap_allocator::deallocate(float* ptr, size_t)
+{
+	math::free_buffer(ptr);
+}
+
+nn::heap_allocator& nn::heap_allocator::global()
+{
+	static heap_allocator heap;
+	return heap;
+}
+
+nn::arena_allocator::arena_allocator(size_t block_size) :block_size(block_size)
+{
+}
+
+nn::arena_allocator::~arena_allocator()
+{
+	for (auto& b : blocks)
+		math::free_buffer(b.data);
+}
+
+float* nn::arena_allocator::allocate(size_t num)
+{
+	if (num == 0)
+		return nullptr;
+
+	num = alloc_helper::align(num);
+
+	// first kept block with room, from the one being filled on
+	while (current < blocks.size() && blocks[current].size - used < num)
+	{
+		current++;
+		used = 0;
+	}
+
+	if (current == blocks.size())
+	{
+		const size_t size = std::max(alloc_helper::align(block_size), num);
+		blocks.push_back({ math::alloc_buffer(size), size });
+	}
+
+	float* ptr = blocks[current].data + used;
+	used += num;
+	total_used += num;
+	return ptr;
+}
+
+void nn::arena_allocator::deallocate(float*, size_t)
+{
+	// released all at once by reset()
+}
+
+void nn::arena_allocator::reset()
+{
+	current = 0;
+	used = 0;
+	total_used = 0;
+}
+
+size_t nn::arena_allocator::size() const
+{
+	return total_used;
+}
+
+size_t nn::arena_allocator::capacity() const
+{
+	size_t total = 0;
+	for (auto& b : blocks)
+		total += b.size;
+	return total;
+}
+
+size_t nn::pool_allocator::size_class(size_t num)
+{
+	const size_t units = (num + alloc_helper::min_class_floats - 1) / alloc_helper::min_class_floats;
+	return std::bit_width(units - 1); // class k holds min_class_floats << k floats
+}
+
+nn::pool_allocator::~pool_allocator()
+{
+	release();
+}
+
+float* nn::pool_allocator::allocate(size_t num)
+{
+	if (num == 0)
+		return nullptr;
+
+	const size_t k = size_class(num);
+
+	{
+		std::lock_guard<std::mutex> guard(lock);
+
+		if (k < free_lists.size() && !free_lists[k].empty())
+		{
+			float* ptr = free_lists[k].back();
+			free_lists[k].pop_back();
+			cached -= alloc_helper::min_class_floats << k;
+			return ptr;
+		}
+	}
+
+	return math::alloc_buffer(alloc_helper::min_class_floats << k);
+}
+
+void nn::pool_allocator::deallocate(float* ptr, size_t num)
+{
+	if (ptr == nullptr)
+		return;
+
+	const size_t k = size_class(num);
+
+	std::lock_guard<std::mutex> guard(lock);
+
+	if (free_lists.size() <= k)
+		free_lists.resize(k + 1);
+
+	free_lists[k].push_back(ptr);
+	cached += alloc_helper::min_class_floats << k;
+}
+
+void nn::pool_allocator::release()
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	for (auto& list : free_lists)
+	{
+		for (float* ptr : list)
+			math::free_buffer(ptr);
+		list.clear();
+	}
+
+	cached = 0;
+}
+
+size_t nn::pool_allocator::cached_size() const
+{
+	std::lock_guard<std::mutex> guard(lock);
+	return cached;
+}
+
+nn::allocator& nn::get_allocator()
+{
+	return alloc_helper::current ? *alloc_helper::current : heap_allocator::global();
+}
+
+nn::allocator_scope::allocator_scope(allocator& alloc) :previous(alloc_helper::current)
+{
+	alloc_helper::current = &alloc;
+}
+
+nn::allocator_scope::~allocator_scope()
+{
+	alloc_helper::current = previous;
+}
@@ -0,0 +1,119 @@
+// FILENAME: nn-alloc.h
+// Pluggable storage for vector, matrix and tensor data
+// Containers take memory from the calling thread's current allocator, and give it back to the allocator it came from
+
+#ifndef NN_ALLOC_H
+#define NN_ALLOC_H
+
+#include <vector>
+#include <mutex>
+
+namespace nn
+{
+	/*
+	USAGE:
+
+	pool_allocator pool; // or arena_allocator, see below
+	{
+		allocator_scope scope(pool); // containers created on this thread now use the pool
+		for_each_sample: ... // freed buffers are recycled, no heap allocation once every size has been seen
+	}
+	size_t n = math::buffer_allocations(); // heap allocations so far, compare before and after a loop
+
+	every allocator must outlive the containers it allocated for.
+	*/
+
+	class allocator
+	{
+	public:
+		virtual ~allocator() {}
+
+		virtual float* allocate(size_t num) = 0; // aligned to math::buffer_alignment, nullptr if num is 0
+		virtual void deallocate(float* ptr, size_t num) = 0; // num: as passed to allocate
+	};
+
+	// default allocator: every request goes to math::alloc_buffer
+	class heap_allocator :public allocator
+	{
+	public:
+		float* allocate(size_t num) override;
+		void deallocate(float* ptr, size_t num) override;
+
+		static heap_allocator& global();
+	};
+
+	// bump pointer over large blocks, deallocate does nothing and reset() rewinds everything at once
+	// for per-pass temporaries. blocks are kept across reset(), so a repeated pass allocates nothing. not thread safe
+	class arena_allocator :public allocator
+	{
+	private:
+		struct block
+		{
+			float* data;
+			size_t size; // floats
+		};
+
+		std::vector<block> blocks;
+		size_t block_size;
+		size_t current = 0, used = 0; // block being filled, floats used in it
+		size_t total_used = 0;
+
+	public:
+		arena_allocator(size_t block_size = 1 << 18); // floats per block, bigger requests get a block of their own
+		~arena_allocator();
+
+		arena_allocator(const arena_allocator&) = delete;
+		arena_allocator& operator =(const arena_allocator&) = delete;
+
+		float* allocate(size_t num) override;
+		void deallocate(float* ptr, size_t num) override;
+
+		void reset(); // every container allocated from the arena must be gone or unused from now on
+		size_t size() const; // floats handed out since the last reset, including alignment padding
+		size_t capacity() const; // floats held in blocks
+	};
+
+	// power-of-two size classes from 16 floats, freed buffers wait on a free list for the next request of their class
+	// thread safe, buffers may be released on any thread
+	class pool_allocator :public allocator
+	{
+	private:
+		std::vector<std::vector<float*>> free_lists; // one per size class
+		size_t cached = 0; // floats waiting on free lists
+
+		mutable std::mutex lock;
+
+		static size_t size_class(size_t num);
+
+	public:
+		pool_allocator() {}
+		~pool_allocator(); // frees cached buffers, buffers still in use must not be released afterwards
+
+		pool_allocator(const pool_allocator&) = delete;
+		pool_allocator& operator =(const pool_allocator&) = delete;
+
+		float* allocate(size_t num) override;
+		void deallocate(float* ptr, size_t num) override;
+
+		void release(); // give cached buffers back to the heap
+		size_t cached_size() const; // floats waiting on free lists
+	};
+
+	allocator& get_allocator(); // current allocator of the calling thread, heap_allocator::global() by default
+
+	// makes an allocator current on the calling thread for the lifetime of the scope
+	class allocator_scope
+	{
+	private:
+		allocator* previous;
+
+	public:
+		allocator_scope(allocator& alloc);
+		~allocator_scope();
+
+		allocator_scope(const allocator_scope&) = delete;
+		allocator_scope& operator =(const allocator_scope&) = delete;
+	};
+}
+
+#endif
@@ -0,0 +1,94 @@
+#include "nn-augment.h"
+#include "nn-exception.h"
+#include "nn-simd.h"
+
+#include <vector>
+#include <cstring>
+#include <algorithm>
+
+nn::augmenter::augmenter(size_t w, size_t h, size_t channels, options opts) :w(w), h(h), c(channels), opts(opts)
+{
+	if (w == 0 || h == 0 || channels == 0)
+		throw numeric_exception("excepting positive integers", __FUNCTION__, __LINE__);
+	if (opts.brightness < 0.0f || opts.brightness > 1.0f)
+		throw numeric_exception("brightness jitter should be in [0, 1]", __FUNCTION__, __LINE__);
+}
+
+size_t nn::augmenter::sample_size() const
+{
+	return c * h * w;
+}
+
+// out(x, y) = in(x - dx, y - dy), in mirrored first if flip; pixels from outside the image are 0
+void nn::augmenter::transform_plane(float* plane, float* scratch, long long dx, long long dy, bool flip) const
+{
+	const long long width = static_cast<long long>(w), height = static_cast<long long>(h);
+
+	memcpy(scratch, plane, sizeof(float) * w * h);
+	float* row_buffer = scratch + w * h; // one mirrored row
+
+	// columns [x_first, x_last) of the output come from the input, the rest is padding
+	const long long x_first = std::clamp(dx, 0LL, width), x_last = std::clamp(width + dx, 0LL, width);
+
+	for (long long y = 0; y < height; y++)
+	{
+		float* dst = plane + y * width;
+		const long long sy = y - dy;
+
+		if (sy < 0 || sy >= height || x_first >= x_last)
+		{
+			std::fill(dst, dst + width, 0.0f);
+			continue;
+		}
+
+		const float* src = scratch + sy * width;
+		if (flip)
+		{
+			simd::kernels().reverse(src, row_buffer, w);
+			src = row_buffer;
+		}
+
+		std::fill(dst, dst + x_first, 0.0f);
+		memcpy(dst + x_first, src + x_first - dx, sizeof(float) * (x_last - x_first));
+		std::fill(dst + x_last, dst + width, 0.0f);
+	}
+}
+
+void nn::augmenter::apply(float* sample, std::mt19937_64& random) const
+{
+	// pad p then crop at a random offset == shift by [-p, p]; translation adds to the same shift
+	const long long shift = static_cast<long long>(opts.crop_padding + opts.max_translate);
+	long long dx = 0, dy = 0;
+
+	if (shift > 0)
+	{
+		std::uniform_int_distribution<long long> offset(-shift, shift);
+		dx = offset(random);
+		dy = offset(random);
+	}
+
+	const bool flip = opts.hflip && (random() & 1);
+
+	if (dx != 0 || dy != 0 || flip)
+	{
+		thread_local std::vector<float> scratch;
+		scratch.resize(w * h + w);
+
+		for (size_t ch = 0; ch < c; ch++)
+			transform_plane(sample + ch * w * h, scratch.data(), dx, dy, flip);
+	}
+
+	if (opts.brightness > 0.0f)
+	{
+		std::uniform_real_distribution<float> factor(1.0f - opts.brightness, 1.0f + opts.brightness);
+		simd::kernels().scale_clamp(sample, factor(random), 0.0f, 1.0f, sample_size());
+	}
+}
+
+void nn::augmenter::apply_batch(float* samples, size_t n, unsigned long long seed) const
+{
+	std::mt19937_64 random(seed);
+
+	for (size_t i = 0; i < n; i++)
+		apply(samples + i * sample_size(), random);
+}
@@ -0,0 +1,40 @@
+// FILENAME: nn-augment.h
+// On-the-fly data augmentation for image samples (float CHW, row-major rows of width w)
+// Applied by batch_loader on its threads, straight into the batch buffers: the stored dataset is never modified
+
+#ifndef NN_AUGMENT_H
+#define NN_AUGMENT_H
+
+#include <random>
+
+namespace nn
+{
+	class augmenter
+	{
+	public:
+		struct options
+		{
+			size_t crop_padding = 0; // random crop from the image zero-padded by this many pixels on every side
+			size_t max_translate = 0; // extra random shift of up to this many pixels in x and y, zero filled
+			bool hflip = false; // mirror horizontally with probability 1/2
+			float brightness = 0.0f; // multiply by a random factor in [1 - brightness, 1 + brightness], clamped to [0, 1]
+		};
+
+	private:
+		size_t w, h, c;
+		options opts;
+
+		void transform_plane(float* plane, float* scratch, long long dx, long long dy, bool flip) const;
+
+	public:
+		augmenter(size_t w, size_t h, size_t channels, options opts);
+
+		size_t sample_size() const; // channels * h * w
+
+		void apply(float* sample, std::mt19937_64& random) const; // in place, sample_size() floats
+		// every sample of a batch (one per row), random state derived from seed only: same seed, same result
+		void apply_batch(float* samples, size_t n, unsigned long long seed) const;
+	};
+}
+
+#endif
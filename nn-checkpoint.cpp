@@ -0,0 +1,213 @@
+#include "nn-checkpoint.h"
+#include "nn-exception.h"
+#include "nn-file.h"
+
+#include <cstring>
+
+//== checkpoint helper functions, local
+
+namespace checkpoint_helper
+{
+	constexpr char magic[8] = { 'N', 'N', 'C', 'K', 'P', 'T', '\0', '\0' };
+	constexpr size_t alignment = 64;
+
+	uint64_t align(uint64_t offset)
+	{
+		return (offset + alignment - 1) / alignment * alignment;
+	}
+}
+
+//== checkpoint_file
+
+nn::checkpoint_state nn::checkpoint_file::load(std::string path, const std::vector<parameter_block>& blocks)
+{
+	file::mapped_file file(path);
+
+	if (file.size() < sizeof(header))
+		throw logic_exception("checkpoint file too small", __FUNCTION__, __LINE__);
+
+	const header* h = reinterpret_cast<const header*>(file.data());
+
+	if (memcmp(h->magic, checkpoint_helper::magic, sizeof(h->magic)) != 0)
+		throw logic_exception("not a checkpoint file", __FUNCTION__, __LINE__);
+	if (h->version != version || h->header_size != sizeof(header))
+		throw logic_exception("checkpoint version mismatch", __FUNCTION__, __LINE__);
+	if (h->file_size != file.size())
+		throw logic_exception("mismatched file size", __FUNCTION__, __LINE__);
+	if (h->num_blocks != blocks.size())
+		throw logic_exception("checkpoint doesn't match the network", __FUNCTION__, __LINE__);
+	if (sizeof(header) + h->num_blocks * sizeof(uint64_t) > file.size())
+		throw logic_exception("checkpoint block table out of range", __FUNCTION__, __LINE__);
+
+	const uint64_t* sizes = reinterpret_cast<const uint64_t*>(file.data() + sizeof(header));
+	uint64_t offset = sizeof(header) + h->num_blocks * sizeof(uint64_t);
+
+	// check everything before touching the network, a bad file leaves it unchanged
+	for (size_t b = 0; b < blocks.size(); b++)
+	{
+		if (sizes[b] != blocks[b].size)
+			throw logic_exception("checkpoint doesn't match the network", __FUNCTION__, __LINE__);
+
+		offset = checkpoint_helper::align(offset) + sizes[b] * sizeof(float);
+		if (offset > file.size())
+			throw logic_exception("checkpoint block out of range", __FUNCTION__, __LINE__);
+	}
+
+	offset = sizeof(header) + h->num_blocks * sizeof(uint64_t);
+	for (size_t b = 0; b < blocks.size(); b++)
+	{
+		offset = checkpoint_helper::align(offset);
+		memcpy(blocks[b].values, file.data() + offset, sizeof(float) * blocks[b].size);
+		offset += sizeof(float) * blocks[b].size;
+	}
+
+	checkpoint_state state;
+	state.step = h->step;
+	state.learning_rate = h->learning_rate;
+	state.sampler_state = { h->sampler_seed, h->sampler_epoch, h->sampler_batch };
+
+	return state;
+}
+
+//== checkpoint_writer
+
+nn::checkpoint_writer::checkpoint_writer(size_t max_pending) :max_pending(max_pending)
+{
+	if (max_pending == 0)
+		throw logic_exception("at least one pending checkpoint is needed", __FUNCTION__, __LINE__);
+
+	thread = std::thread(&checkpoint_writer::writer_loop, this);
+}
+
+nn::checkpoint_writer::~checkpoint_writer()
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+	}
+	changed.notify_all();
+
+	thread.join();
+}
+
+bool nn::checkpoint_writer::write_file(const snapshot& s)
+{
+	checkpoint_file::header h = {};
+	memcpy(h.magic, checkpoint_helper::magic, sizeof(h.magic));
+	h.version = checkpoint_file::version;
+	h.header_size = sizeof(h);
+	h.step = s.state.step;
+	h.learning_rate = s.state.learning_rate;
+	h.sampler_seed = s.state.sampler_state.seed;
+	h.sampler_epoch = s.state.sampler_state.epoch;
+	h.sampler_batch = s.state.sampler_state.batch;
+	h.num_blocks = s.sizes.size();
+
+	try
+	{
+		file::binary_writer writer(s.path);
+
+		writer.write(&h, sizeof(h));
+		for (size_t size : s.sizes)
+		{
+			const uint64_t value = size;
+			writer.write(&value, sizeof(value));
+		}
+
+		const float* values = s.values.data();
+		for (size_t size : s.sizes)
+		{
+			writer.pad_to(checkpoint_helper::alignment);
+			writer.write(values, sizeof(float) * size);
+			values += size;
+		}
+
+		h.file_size = writer.position();
+		writer.write_at(0, &h, sizeof(h));
+
+		return writer.commit();
+	}
+	catch (const logic_exception&)
+	{
+		return false;
+	}
+}
+
+void nn::checkpoint_writer::writer_loop()
+{
+	std::unique_lock<std::mutex> guard(lock);
+
+	while (true)
+	{
+		changed.wait(guard, [this]() { return stopping || !queue.empty(); });
+
+		if (queue.empty())
+			return; // stopping, everything written
+
+		// save() only appends, which keeps references to the front valid
+		const snapshot* current = &queue.front();
+		writing = true;
+		guard.unlock();
+
+		const bool success = write_file(*current);
+
+		guard.lock();
+
+		if (!success)
+			failed++;
+
+		spare.push_back(std::move(queue.front()));
+		queue.pop_front();
+		writing = false;
+
+		changed.notify_all();
+	}
+}
+
+void nn::checkpoint_writer::save(std::string path, const std::vector<parameter_block>& blocks, const checkpoint_state& state)
+{
+	std::unique_lock<std::mutex> guard(lock);
+
+	// the snapshot being written doesn't count, it's already out of the way of training
+	changed.wait(guard, [this]() { return queue.size() - (writing ? 1 : 0) < max_pending; });
+
+	snapshot s;
+	if (!spare.empty())
+	{
+		s = std::move(spare.back());
+		spare.pop_back();
+	}
+
+	guard.unlock();
+
+	size_t total = 0;
+	for (auto& block : blocks)
+		total += block.size;
+
+	s.path = path;
+	s.state = state;
+	s.sizes.resize(blocks.size());
+	s.values.resize(total);
+
+	float* dst = s.values.data();
+	for (size_t b = 0; b < blocks.size(); b++)
+	{
+		s.sizes[b] = blocks[b].size;
+		memcpy(dst, blocks[b].values, sizeof(float) * blocks[b].size);
+		dst += blocks[b].size;
+	}
+
+	guard.lock();
+	queue.push_back(std::move(s));
+	changed.notify_all();
+}
+
+bool nn::checkpoint_writer::wait()
+{
+	std::unique_lock<std::mutex> guard(lock);
+	changed.wait(guard, [this]() { return queue.empty(); });
+
+	const bool success = failed == 0;
+	failed = 0;
+	return success;
+}
@@ -0,0 +1,120 @@
+// FILENAME: nn-checkpoint.h
+// Training checkpoints: weights, learning rate, step count and sampler position, written on a background thread
+// save() only copies the parameters into a snapshot buffer, the file is written while training continues
+
+#ifndef NN_CHECKPOINT_H
+#define NN_CHECKPOINT_H
+
+#include "nn-layer.h"
+#include "nn-loader.h"
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <cstdint>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace nn
+{
+	/*
+	FILE LAYOUT (version 2, little-endian):
+
+	checkpoint_file::header
+	block sizes: num_blocks uint64 (floats per parameter block)
+	parameter blocks, each 64-byte aligned, in get_parameters() order
+	*/
+
+	// everything besides the weights needed to resume a run
+	struct checkpoint_state
+	{
+		size_t step = 0; // batches trained so far
+		float learning_rate = 0.0f;
+		sampler::state sampler_state = {}; // see batch_loader::get_sampler_state
+	};
+
+	namespace checkpoint_file
+	{
+		constexpr unsigned int version = 2; // 2: sampler batch position, rows of the parameter blocks padded (math::row_stride)
+
+		struct header
+		{
+			char magic[8]; // "NNCKPT\0\0"
+			uint32_t version;
+			uint32_t header_size; // sizeof(header)
+			uint64_t step;
+			float learning_rate;
+			uint32_t reserved;
+			uint64_t sampler_seed, sampler_epoch, sampler_batch;
+			uint64_t num_blocks;
+			uint64_t file_size;
+		};
+
+		// read a checkpoint into blocks, which must have the sizes it was saved with (same network). throws logic_exception
+		checkpoint_state load(std::string path, const std::vector<parameter_block>& blocks);
+	}
+
+	class checkpoint_writer
+	{
+	private:
+		struct snapshot
+		{
+			std::string path;
+			checkpoint_state state;
+			std::vector<size_t> sizes;
+			std::vector<float> values; // all blocks back to back
+		};
+
+		std::deque<snapshot> queue; // waiting to be written, front is being written
+		std::vector<snapshot> spare; // written snapshots, buffers reused by save()
+		size_t max_pending;
+		size_t failed = 0;
+		bool writing = false;
+		bool stopping = false;
+
+		std::mutex lock;
+		std::condition_variable changed;
+		std::thread thread;
+
+		void writer_loop();
+		static bool write_file(const snapshot& s);
+
+	public:
+		// max_pending: snapshots allowed to wait for the disk, save() blocks when that many are queued
+		checkpoint_writer(size_t max_pending = 1);
+		~checkpoint_writer(); // writes every queued checkpoint first
+
+		checkpoint_writer(const checkpoint_writer&) = delete;
+		checkpoint_writer& operator =(const checkpoint_writer&) = delete;
+
+		// copy the parameter values and queue the file, returns before anything is written
+		void save(std::string path, const std::vector<parameter_block>& blocks, const checkpoint_state& state);
+
+		// network_T: a base_network implementing get_parameters (see nn-parallel.h)
+		template<typename network_T>
+		void save(std::string path, network_T& network, size_t step, const sampler::state& sampler_state)
+		{
+			std::vector<parameter_block> blocks;
+			network.get_parameters(blocks);
+			save(path, blocks, checkpoint_state{ step, network.learning_rate, sampler_state });
+		}
+
+		// block until every queued checkpoint is on disk, false if any write failed since the last call
+		bool wait();
+	};
+
+	// restore the weights and learning rate of network, returns the state to resume the loader and step count from
+	template<typename network_T>
+	checkpoint_state load_checkpoint(std::string path, network_T& network)
+	{
+		std::vector<parameter_block> blocks;
+		network.get_parameters(blocks);
+
+		checkpoint_state state = checkpoint_file::load(path, blocks);
+		network.learning_rate = state.learning_rate;
+		return state;
+	}
+}
+
+#endif
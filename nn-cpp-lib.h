@@ -2,11 +2,22 @@
 #define NN_CPP_LIB_H
 
 #include "nn-exception.h"
+#include "nn-alloc.h"
 #include "nn-math.h"
+#include "nn-simd.h"
 #include "nn-file.h"
 #include "nn-dataset.h"
+#include "nn-augment.h"
+#include "nn-loader.h"
 #include "nn-activate-function.h"
 #include "nn-layer.h"
+#include "nn-planner.h"
+#include "nn-model.h"
+#include "nn-checkpoint.h"
+#include "nn-inference.h"
+#include "nn-scheduler.h"
+#include "nn-thread.h"
+#include "nn-parallel.h"
 #include "nn-image.h"
 
 // NOTE: some examples are provided in nn-example.h, be sure to check out
@@ -1,13 +1,15 @@
 #define _CRT_SECURE_NO_WARNINGS
 
 #include <array>
+#include <algorithm>
 
 #include "nn-dataset.h"
 #include "nn-file.h"
+#include "nn-simd.h"
 
-nn::cifar10_data::cifar10_data(const nn::tensor& t, size_t label)
+nn::cifar10_data::cifar10_data(nn::tensor&& t, size_t label)
 {
-	data = t;
+	data = std::move(t);
 	data_label = label;
 	target = nn::math::one_hot(10, label);
 }
@@ -25,44 +27,126 @@ nn::cifar10_dataset::~cifar10_dataset()
 	set.clear();
 }
 
-void nn::cifar10_dataset::add_source(const std::string file_path)
-{
-	nn::file::file_binary_data binary_data = nn::file::file_read_bytes(file_path);
-
-	if (!binary_data.valid)
-		return;
+//== cifar10 helper functions, local
 
-	if (binary_data.size != 30730000)
-		return;
-
-	set.reserve(set.size() + 10000);
+namespace cifar10_helper
+{
+	constexpr size_t record_size = 3073; // label byte + 3 * 32 * 32 pixels
+	constexpr size_t records_per_file = 10000;
 
-	for (size_t i = 0; i < 10000; i++)
+	nn::cifar10_data* decode_record(const unsigned char* ptr)
 	{
-		unsigned char const* ptr = binary_data.data + i * 3073;
-
 		// store label
 		size_t label = *ptr;
 		ptr++;
 
 		// get data
-		tensor data(3, 32, 32); // tensor, 3(channels)*32(width)*32(height)
+		nn::tensor data(3, 32, 32); // tensor, 3(channels)*32(width)*32(height), one aligned buffer
 
 		for (size_t c = 0; c < 3; c++)
 		{
-			auto& mat = data.channel(c);
+			nn::matrix& plane = data.channel(c);
 
-			for (size_t x = 0; x < 32; x++)
-				for (size_t y = 0; y < 32; y++)
-					mat.at(x, y) = ptr[x * 32 + y] / 255.0f;
+			for (size_t y = 0; y < 32; y++)
+			{
+				float* dst = plane.row(y);
+				for (size_t x = 0; x < 32; x++)
+					dst[x] = ptr[x * 32 + y] / 255.0f; // same as plane.at(x, y)
+			}
 
 			ptr += 1024;
 		}
 
-		set.push_back(new nn::cifar10_data(data, label));
+		return new nn::cifar10_data(std::move(data), label);
+	}
+}
+
+void nn::cifar10_dataset::add_source(const std::string file_path)
+{
+	nn::file::file_binary_data binary_data = nn::file::file_read_bytes(file_path);
+
+	if (!binary_data.valid)
+		return;
+
+	if (binary_data.size != cifar10_helper::record_size * cifar10_helper::records_per_file)
+		return;
+
+	set.reserve(set.size() + cifar10_helper::records_per_file);
+
+	for (size_t i = 0; i < cifar10_helper::records_per_file; i++)
+		set.push_back(cifar10_helper::decode_record(binary_data.data + i * cifar10_helper::record_size));
+}
+
+void nn::cifar10_dataset::add_sources(const std::vector<std::string>& file_paths, thread_pool& pool)
+{
+	// every file decodes into its own slot range, so the final order is the order of file_paths
+	std::vector<std::vector<cifar10_data*>> decoded(file_paths.size());
+
+	pool.parallel_for(0, file_paths.size(), [&](size_t f)
+		{
+			nn::file::file_binary_data binary_data = nn::file::file_read_bytes(file_paths[f]);
+
+			if (!binary_data.valid || binary_data.size != cifar10_helper::record_size * cifar10_helper::records_per_file)
+				return; // skipped, same as add_source
+
+			auto& records = decoded[f];
+			records.resize(cifar10_helper::records_per_file);
+
+			// records of one file are split further, so a single file still uses every thread
+			pool.parallel_for(0, cifar10_helper::records_per_file, [&](size_t i)
+				{
+					records[i] = cifar10_helper::decode_record(binary_data.data + i * cifar10_helper::record_size);
+				}, 256);
+		});
+
+	size_t total = 0;
+	for (auto& records : decoded)
+		total += records.size();
+
+	set.reserve(set.size() + total);
+	for (auto& records : decoded)
+		set.insert(set.end(), records.begin(), records.end());
+}
+
+namespace dataset_helper
+{
+	// gather float samples kept as separate objects
+	template<typename set_T>
+	void fill_batch(const set_T& set, const size_t* indices, size_t n, float* inputs, float* targets, size_t input_size, size_t target_size)
+	{
+		for (size_t i = 0; i < n; i++)
+		{
+			if (indices[i] >= set.size())
+				throw nn::logic_exception("sample index out of range", __FUNCTION__, __LINE__);
+
+			auto item = set[indices[i]];
+			item->get_data().copy_to(inputs + i * input_size); // drops the row padding
+			if (targets != nullptr)
+				memcpy(targets + i * target_size, item->get_target().data(), sizeof(float) * target_size);
+		}
 	}
 }
 
+size_t nn::cifar10_dataset::size() const
+{
+	return set.size();
+}
+
+size_t nn::cifar10_dataset::input_size() const
+{
+	return 3 * 32 * 32;
+}
+
+size_t nn::cifar10_dataset::target_size() const
+{
+	return set.empty() ? 0 : set[0]->get_target().size();
+}
+
+void nn::cifar10_dataset::fill_batch(const size_t* indices, size_t n, float* inputs, float* targets) const
+{
+	dataset_helper::fill_batch(set, indices, n, inputs, targets, input_size(), target_size());
+}
+
 std::string nn::cifar10_dataset::get_label(size_t index)
 {
 	static const std::array<std::string, 10> labels = { "airplane","automobile","bird","cat","deer","dog","frog","horse","ship","truck" };
@@ -96,9 +180,9 @@ namespace mnist_helper
 	constexpr size_t minimum_label_size = 8;
 
 	// read int from mnist dataset
-	int mnist_read_int(unsigned char* ptr)
+	int mnist_read_int(const unsigned char* ptr)
 	{
-		int i = *((int*)ptr);
+		int i = *((const int*)ptr);
 		if (nn::math::little_endian)
 			return nn::math::reverse_order_int(i);
 		else
@@ -177,6 +261,26 @@ void nn::mnist_dataset::add_source(std::string data_path, std::string label_path
 		ptr->gen_targets(largest_label);
 }
 
+size_t nn::mnist_dataset::size() const
+{
+	return set.size();
+}
+
+size_t nn::mnist_dataset::input_size() const
+{
+	return set.empty() ? 0 : set[0]->get_data().width() * set[0]->get_data().height();
+}
+
+size_t nn::mnist_dataset::target_size() const
+{
+	return set.empty() ? 0 : set[0]->get_target().size();
+}
+
+void nn::mnist_dataset::fill_batch(const size_t* indices, size_t n, float* inputs, float* targets) const
+{
+	dataset_helper::fill_batch(set, indices, n, inputs, targets, input_size(), target_size());
+}
+
 nn::mnist_data::mnist_data(const nn::matrix& m, size_t label)
 {
 	data = m;
@@ -192,3 +296,537 @@ void nn::mnist_data::gen_targets(size_t max_label)
 {
 	target = math::one_hot(max_label, data_label);
 }
+
+//== image_dataset
+
+size_t nn::image_dataset::sample_size() const
+{
+	return channels() * height() * width();
+}
+
+size_t nn::image_dataset::input_size() const
+{
+	return sample_size();
+}
+
+size_t nn::image_dataset::target_size() const
+{
+	return num_labels();
+}
+
+void nn::image_dataset::get_sample(size_t index, float* dst) const
+{
+	simd::kernels().normalize_u8(get_pixels(index), dst, sample_size());
+}
+
+void nn::image_dataset::get_target(size_t index, float* dst) const
+{
+	const size_t num = num_labels();
+
+	const size_t label = get_label(index);
+	if (label >= num)
+		throw numeric_exception("label out of range", __FUNCTION__, __LINE__);
+
+	for (size_t i = 0; i < num; i++)
+		dst[i] = 0.0f;
+
+	dst[label] = 1.0f;
+}
+
+void nn::image_dataset::fill_batch(const size_t* indices, size_t n, float* inputs, float* targets) const
+{
+	const size_t input_size = sample_size(), target_size = num_labels();
+
+	for (size_t i = 0; i < n; i++)
+	{
+		if (indices[i] >= size())
+			throw logic_exception("sample index out of range", __FUNCTION__, __LINE__);
+
+		get_sample(indices[i], inputs + i * input_size);
+		if (targets != nullptr)
+			get_target(indices[i], targets + i * target_size);
+	}
+}
+
+//== compact_dataset
+
+nn::compact_dataset::compact_dataset(size_t w, size_t h, size_t channels, size_t num_labels) :image_w(w), image_h(h), image_c(channels), label_count(num_labels)
+{
+	if (w == 0 || h == 0 || channels == 0 || num_labels == 0)
+		throw numeric_exception("excepting positive integers", __FUNCTION__, __LINE__);
+}
+
+nn::compact_dataset::compact_dataset(const image_dataset& src) :image_w(src.width()), image_h(src.height()), image_c(src.channels()), label_count(src.num_labels())
+{
+	reserve(src.size());
+
+	for (size_t i = 0; i < src.size(); i++)
+		add_sample(src.get_pixels(i), src.get_label(i));
+}
+
+void nn::compact_dataset::reserve(size_t num_samples)
+{
+	pixels.reserve(num_samples * sample_size());
+	labels.reserve(num_samples);
+}
+
+void nn::compact_dataset::add_sample(const unsigned char* sample, size_t label)
+{
+	if (label >= label_count)
+		throw numeric_exception("label out of range", __FUNCTION__, __LINE__);
+
+	pixels.insert(pixels.end(), sample, sample + sample_size());
+	labels.push_back(static_cast<unsigned int>(label));
+}
+
+void nn::compact_dataset::clear()
+{
+	pixels.clear();
+	labels.clear();
+}
+
+void nn::compact_dataset::resize(size_t num_samples)
+{
+	pixels.resize(num_samples * sample_size());
+	labels.resize(num_samples);
+}
+
+unsigned char* nn::compact_dataset::get_pixels(size_t index)
+{
+	_ASSERT(index < labels.size());
+	return pixels.data() + index * sample_size();
+}
+
+void nn::compact_dataset::set_label(size_t index, size_t label)
+{
+	_ASSERT(index < labels.size());
+
+	if (label >= label_count)
+		throw numeric_exception("label out of range", __FUNCTION__, __LINE__);
+
+	labels[index] = static_cast<unsigned int>(label);
+}
+
+size_t nn::compact_dataset::size() const
+{
+	return labels.size();
+}
+
+size_t nn::compact_dataset::width() const
+{
+	return image_w;
+}
+
+size_t nn::compact_dataset::height() const
+{
+	return image_h;
+}
+
+size_t nn::compact_dataset::channels() const
+{
+	return image_c;
+}
+
+size_t nn::compact_dataset::num_labels() const
+{
+	return label_count;
+}
+
+size_t nn::compact_dataset::get_label(size_t index) const
+{
+	_ASSERT(index < labels.size());
+	return labels[index];
+}
+
+const unsigned char* nn::compact_dataset::get_pixels(size_t index) const
+{
+	_ASSERT(index < labels.size());
+	return pixels.data() + index * sample_size();
+}
+
+const unsigned char* nn::compact_dataset::data() const
+{
+	return pixels.data();
+}
+
+//== mapped_mnist_dataset
+
+nn::mapped_mnist_dataset::mapped_mnist_dataset(std::string data_path, std::string label_path)
+{
+	add_source(data_path, label_path);
+}
+
+void nn::mapped_mnist_dataset::add_source(std::string data_path, std::string label_path)
+{
+	source src{ file::mapped_file(data_path), file::mapped_file(label_path), 0 };
+
+	if (src.images.size() <= mnist_helper::minimum_data_size || src.labels.size() <= mnist_helper::minimum_label_size)
+		throw numeric_exception("input file obviously too small", __FUNCTION__, __LINE__);
+
+	const unsigned char* data_ptr = src.images.data();
+	const unsigned char* label_ptr = src.labels.data();
+
+	// same checks as mnist_dataset::add_source
+	if (mnist_helper::mnist_read_int(data_ptr) != mnist_helper::mnist_data_mgnum || mnist_helper::mnist_read_int(label_ptr) != mnist_helper::mnist_label_mgnum)
+		throw numeric_exception("input file magic number mismatch", __FUNCTION__, __LINE__);
+
+	int mnist_image_count = mnist_helper::mnist_read_int(data_ptr + 4);
+	int mnist_w = mnist_helper::mnist_read_int(data_ptr + 8);
+	int mnist_h = mnist_helper::mnist_read_int(data_ptr + 12);
+
+	if (mnist_image_count != mnist_helper::mnist_read_int(label_ptr + 4))
+		throw numeric_exception("mismatched image count", __FUNCTION__, __LINE__);
+	if (mnist_image_count <= 0 || mnist_w <= 0 || mnist_h <= 0)
+		throw numeric_exception("excepting positive integers", __FUNCTION__, __LINE__);
+
+	if (src.images.size() != 16 + static_cast<size_t>(mnist_w) * mnist_h * mnist_image_count
+		|| src.labels.size() != 8 + static_cast<size_t>(mnist_image_count))
+		throw numeric_exception("mismatched file size", __FUNCTION__, __LINE__);
+
+	if (!sources.empty() && (static_cast<size_t>(mnist_w) != image_w || static_cast<size_t>(mnist_h) != image_h))
+		throw numeric_exception("image size differs from previous sources", __FUNCTION__, __LINE__);
+
+	src.count = static_cast<size_t>(mnist_image_count);
+
+	// labels are tiny, scan them once for the target size
+	for (size_t i = 0; i < src.count; i++)
+		largest_label = std::max<size_t>(largest_label, label_ptr[8 + i]);
+
+	image_w = mnist_w;
+	image_h = mnist_h;
+	total += src.count;
+
+	sources.push_back(std::move(src));
+}
+
+const nn::mapped_mnist_dataset::source& nn::mapped_mnist_dataset::locate(size_t& index) const
+{
+	for (auto& src : sources)
+	{
+		if (index < src.count)
+			return src;
+		index -= src.count;
+	}
+
+	throw logic_exception("sample index out of range", __FUNCTION__, __LINE__);
+}
+
+size_t nn::mapped_mnist_dataset::size() const
+{
+	return total;
+}
+
+size_t nn::mapped_mnist_dataset::width() const
+{
+	return image_w;
+}
+
+size_t nn::mapped_mnist_dataset::height() const
+{
+	return image_h;
+}
+
+size_t nn::mapped_mnist_dataset::channels() const
+{
+	return 1;
+}
+
+size_t nn::mapped_mnist_dataset::num_labels() const
+{
+	return largest_label + 1;
+}
+
+size_t nn::mapped_mnist_dataset::get_label(size_t index) const
+{
+	const source& src = locate(index);
+	return src.labels.data()[8 + index];
+}
+
+const unsigned char* nn::mapped_mnist_dataset::get_pixels(size_t index) const
+{
+	const source& src = locate(index);
+	return src.images.data() + 16 + index * image_w * image_h;
+}
+
+//== mapped_cifar10_dataset
+
+nn::mapped_cifar10_dataset::mapped_cifar10_dataset(std::string file_path)
+{
+	add_source(file_path);
+}
+
+void nn::mapped_cifar10_dataset::add_source(std::string file_path)
+{
+	file::mapped_file file(file_path);
+
+	if (file.size() != cifar10_helper::record_size * cifar10_helper::records_per_file)
+		throw numeric_exception("mismatched file size", __FUNCTION__, __LINE__);
+
+	sources.push_back(std::move(file));
+}
+
+const unsigned char* nn::mapped_cifar10_dataset::record(size_t index) const
+{
+	if (index >= size())
+		throw logic_exception("sample index out of range", __FUNCTION__, __LINE__);
+
+	return sources[index / cifar10_helper::records_per_file].data() + (index % cifar10_helper::records_per_file) * cifar10_helper::record_size;
+}
+
+size_t nn::mapped_cifar10_dataset::size() const
+{
+	return sources.size() * cifar10_helper::records_per_file;
+}
+
+size_t nn::mapped_cifar10_dataset::width() const
+{
+	return 32;
+}
+
+size_t nn::mapped_cifar10_dataset::height() const
+{
+	return 32;
+}
+
+size_t nn::mapped_cifar10_dataset::channels() const
+{
+	return 3;
+}
+
+size_t nn::mapped_cifar10_dataset::num_labels() const
+{
+	return 10;
+}
+
+size_t nn::mapped_cifar10_dataset::get_label(size_t index) const
+{
+	return record(index)[0];
+}
+
+const unsigned char* nn::mapped_cifar10_dataset::get_pixels(size_t index) const
+{
+	return record(index) + 1;
+}
+
+//== cached_dataset
+
+namespace cache_helper
+{
+	constexpr char magic[8] = { 'N', 'N', 'C', 'A', 'C', 'H', 'E', '\0' };
+	constexpr size_t alignment = 64;
+	constexpr size_t chunk = 256; // samples converted per fill_batch call while writing
+
+	uint64_t align(uint64_t offset)
+	{
+		return (offset + alignment - 1) / alignment * alignment;
+	}
+
+	// a * b, false if it doesn't fit in 64 bits
+	bool checked_mul(uint64_t a, uint64_t b, uint64_t& result)
+	{
+		if (b != 0 && a > UINT64_MAX / b)
+			return false;
+
+		result = a * b;
+		return true;
+	}
+
+	// checked size computation, a damaged header must not overflow into a small bogus size
+	bool block_end(uint64_t offset, uint64_t count, uint64_t item_size, uint64_t file_size)
+	{
+		if (item_size != 0 && count > (file_size - std::min(offset, file_size)) / item_size)
+			return false;
+
+		return offset <= file_size && offset + count * item_size <= file_size;
+	}
+}
+
+const char* nn::cached_dataset::validate(const file::mapped_file& file)
+{
+	if (file.size() < sizeof(header))
+		return "cache file too small";
+
+	const header* h = reinterpret_cast<const header*>(file.data());
+
+	if (memcmp(h->magic, cache_helper::magic, sizeof(h->magic)) != 0)
+		return "not a dataset cache";
+	if (h->version != version || h->header_size != sizeof(header))
+		return "dataset cache version mismatch";
+	if (h->file_size != file.size())
+		return "mismatched file size";
+	if (h->count == 0 || h->input_size == 0 || h->target_size == 0)
+		return "invalid dataset cache shape";
+	// row sizes in bytes below must not wrap, no row can be larger than the file anyway
+	if (h->input_size > h->file_size / sizeof(float) || h->target_size > h->file_size / sizeof(float))
+		return "invalid dataset cache shape";
+
+	uint64_t plane, pixels;
+	if (!cache_helper::checked_mul(h->width, h->height, plane) || !cache_helper::checked_mul(plane, h->channels, pixels) || pixels != h->input_size)
+		return "invalid dataset cache shape";
+	if (h->samples_offset % cache_helper::alignment != 0 || h->labels_offset % cache_helper::alignment != 0 || h->targets_offset % cache_helper::alignment != 0)
+		return "misaligned dataset cache block";
+	if (!cache_helper::block_end(h->samples_offset, h->count, h->input_size * sizeof(float), h->file_size)
+		|| !cache_helper::block_end(h->labels_offset, h->count, sizeof(uint32_t), h->file_size)
+		|| !cache_helper::block_end(h->targets_offset, h->count, h->target_size * sizeof(float), h->file_size))
+		return "dataset cache block out of range";
+
+	return nullptr;
+}
+
+nn::cached_dataset::cached_dataset(std::string path) :file(path)
+{
+	if (const char* error = validate(file))
+		throw logic_exception(error, __FUNCTION__, __LINE__);
+
+	info = reinterpret_cast<const header*>(file.data());
+	samples = reinterpret_cast<const float*>(file.data() + info->samples_offset);
+	labels = reinterpret_cast<const uint32_t*>(file.data() + info->labels_offset);
+	targets = reinterpret_cast<const float*>(file.data() + info->targets_offset);
+}
+
+bool nn::cached_dataset::write(std::string path, const batch_source& src)
+{
+	const size_t count = src.size(), input = src.input_size(), target = src.target_size();
+
+	if (count == 0 || input == 0 || target == 0)
+		throw logic_exception("can't cache an empty dataset", __FUNCTION__, __LINE__);
+
+	header h = {};
+	memcpy(h.magic, cache_helper::magic, sizeof(h.magic));
+	h.version = version;
+	h.header_size = sizeof(header);
+	h.count = count;
+	h.input_size = input;
+	h.target_size = target;
+
+	if (auto image = dynamic_cast<const image_dataset*>(&src))
+	{
+		h.width = image->width();
+		h.height = image->height();
+		h.channels = image->channels();
+	}
+	else
+	{
+		h.width = input;
+		h.height = 1;
+		h.channels = 1;
+	}
+
+	h.samples_offset = cache_helper::align(sizeof(header));
+	h.labels_offset = cache_helper::align(h.samples_offset + count * input * sizeof(float));
+	h.targets_offset = cache_helper::align(h.labels_offset + count * sizeof(uint32_t));
+	h.file_size = h.targets_offset + count * target * sizeof(float);
+
+	file::binary_writer writer(path);
+	writer.write(&h, sizeof(h));
+
+	// samples are streamed in chunks so memory use doesn't grow with the dataset, labels and targets are small and kept
+	std::vector<size_t> indices(cache_helper::chunk);
+	std::vector<float> sample_chunk(cache_helper::chunk * input), target_list(count * target);
+	std::vector<uint32_t> label_list(count);
+
+	writer.pad_to(cache_helper::alignment);
+	for (size_t first = 0; first < count; first += cache_helper::chunk)
+	{
+		const size_t n = std::min(cache_helper::chunk, count - first);
+		for (size_t i = 0; i < n; i++)
+			indices[i] = first + i;
+
+		src.fill_batch(indices.data(), n, sample_chunk.data(), target_list.data() + first * target);
+		writer.write(sample_chunk.data(), n * input * sizeof(float));
+	}
+
+	for (size_t i = 0; i < count; i++)
+	{
+		const float* row = target_list.data() + i * target;
+		label_list[i] = static_cast<uint32_t>(std::max_element(row, row + target) - row);
+	}
+
+	writer.pad_to(cache_helper::alignment);
+	writer.write(label_list.data(), count * sizeof(uint32_t));
+
+	writer.pad_to(cache_helper::alignment);
+	writer.write(target_list.data(), count * target * sizeof(float));
+
+	_ASSERT(writer.position() == h.file_size);
+	return writer.commit();
+}
+
+bool nn::cached_dataset::check(std::string path)
+{
+	if (!file::file_exists(path))
+		return false;
+
+	try
+	{
+		file::mapped_file file(path);
+		return validate(file) == nullptr;
+	}
+	catch (const logic_exception&)
+	{
+		return false;
+	}
+}
+
+size_t nn::cached_dataset::size() const
+{
+	return info->count;
+}
+
+size_t nn::cached_dataset::input_size() const
+{
+	return info->input_size;
+}
+
+size_t nn::cached_dataset::target_size() const
+{
+	return info->target_size;
+}
+
+size_t nn::cached_dataset::width() const
+{
+	return info->width;
+}
+
+size_t nn::cached_dataset::height() const
+{
+	return info->height;
+}
+
+size_t nn::cached_dataset::channels() const
+{
+	return info->channels;
+}
+
+size_t nn::cached_dataset::get_label(size_t index) const
+{
+	_ASSERT(index < size());
+	return labels[index];
+}
+
+const float* nn::cached_dataset::get_sample(size_t index) const
+{
+	_ASSERT(index < size());
+	return samples + index * info->input_size;
+}
+
+const float* nn::cached_dataset::get_target(size_t index) const
+{
+	_ASSERT(index < size());
+	return targets + index * info->target_size;
+}
+
+void nn::cached_dataset::fill_batch(const size_t* indices, size_t n, float* inputs, float* targets) const
+{
+	const size_t input = info->input_size, target = info->target_size;
+
+	for (size_t i = 0; i < n; i++)
+	{
+		if (indices[i] >= size())
+			throw logic_exception("sample index out of range", __FUNCTION__, __LINE__);
+
+		memcpy(inputs + i * input, get_sample(indices[i]), input * sizeof(float));
+		if (targets != nullptr)
+			memcpy(targets + i * target, get_target(indices[i]), target * sizeof(float));
+	}
+}
@@ -7,11 +7,29 @@
 
 #include <vector>
 #include <string>
+#include <cstdint>
 
 #include "nn-math.h"
+#include "nn-file.h"
+#include "nn-thread.h"
 
 namespace nn
 {
+	// anything that can gather training batches: flattened inputs and targets, one sample per row
+	// fill_batch must be safe to call from several threads at once (used by batch_loader, see nn-loader.h)
+	class batch_source
+	{
+	public:
+		virtual ~batch_source() {}
+
+		virtual size_t size() const = 0; // number of samples
+		virtual size_t input_size() const = 0; // floats per input row
+		virtual size_t target_size() const = 0; // floats per target row
+
+		// inputs: n * input_size() floats, targets: n * target_size() floats (may be nullptr)
+		virtual void fill_batch(const size_t* indices, size_t n, float* inputs, float* targets) const = 0;
+	};
+
 	// base class for storing dataset image
 	template<typename DAT, typename TGT>
 	struct nn_data
@@ -36,11 +54,11 @@ namespace nn
 		size_t data_label;
 
 	public:
-		cifar10_data(const nn::tensor& t, size_t label);
+		cifar10_data(nn::tensor&& t, size_t label); // takes over the tensor buffer, no copy
 		size_t get_label();
 	};
 
-	class cifar10_dataset
+	class cifar10_dataset : public batch_source
 	{
 	public:
 		std::vector<cifar10_data*> set;
@@ -51,7 +69,14 @@ namespace nn
 		~cifar10_dataset();
 
 		void add_source(const std::string file_path);
+		// read and decode several files concurrently. samples end up in list order, as if add_source was called for each
+		void add_sources(const std::vector<std::string>& file_paths, thread_pool& pool = thread_pool::global());
 		static std::string get_label(size_t index);
+
+		size_t size() const;
+		size_t input_size() const; // 3 * 32 * 32
+		size_t target_size() const;
+		void fill_batch(const size_t* indices, size_t n, float* inputs, float* targets) const;
 	};
 
 	struct mnist_data :public nn_data<nn::matrix, nn::vector>
@@ -66,7 +91,7 @@ namespace nn
 		void gen_targets(size_t max_label);
 	};
 
-	class mnist_dataset
+	class mnist_dataset : public batch_source
 	{
 	public:
 		std::vector<mnist_data*> set;
@@ -78,6 +103,181 @@ namespace nn
 
 		void flip_all(); // flip mnist data
 		void add_source(std::string data_path, std::string label_path);
+
+		size_t size() const;
+		size_t input_size() const; // w * h
+		size_t target_size() const;
+		void fill_batch(const size_t* indices, size_t n, float* inputs, float* targets) const;
+	};
+
+	//== 8-bit datasets: samples are kept as raw bytes and converted to float on demand
+
+	// base class for datasets storing 8-bit samples, channels * height * width bytes each (CHW, row-major)
+	class image_dataset : public batch_source
+	{
+	public:
+		virtual size_t size() const = 0; // number of samples
+		virtual size_t width() const = 0;
+		virtual size_t height() const = 0;
+		virtual size_t channels() const = 0;
+		virtual size_t num_labels() const = 0; // length of the one-hot targets
+
+		virtual size_t get_label(size_t index) const = 0;
+		virtual const unsigned char* get_pixels(size_t index) const = 0; // sample_size() bytes, valid while the dataset lives
+
+		size_t sample_size() const; // channels * height * width
+		size_t input_size() const; // sample_size()
+		size_t target_size() const; // num_labels()
+
+		void get_sample(size_t index, float* dst) const; // sample_size() floats, pixel / 255 (SIMD)
+		void get_target(size_t index, float* dst) const; // num_labels() floats, one-hot
+
+		// gather samples: inputs gets one sample per row (n * sample_size() floats), targets one one-hot target per row
+		// targets may be nullptr
+		void fill_batch(const size_t* indices, size_t n, float* inputs, float* targets) const;
+	};
+
+	// all samples in one contiguous byte array plus a label array: no per-sample allocations, 4x smaller than float samples
+	class compact_dataset : public image_dataset
+	{
+	private:
+		std::vector<unsigned char> pixels;
+		std::vector<unsigned int> labels;
+		size_t image_w, image_h, image_c, label_count;
+
+	public:
+		compact_dataset(size_t w, size_t h, size_t channels, size_t num_labels);
+		compact_dataset(const image_dataset& src); // copy of every sample of src, eg. to make a mapped dataset resident
+
+		void reserve(size_t num_samples);
+		void add_sample(const unsigned char* sample, size_t label); // sample_size() bytes, CHW
+		void clear();
+
+		// fill in place, eg. from several threads: resize first, then write each sample through get_pixels/set_label
+		void resize(size_t num_samples); // new samples are black with label 0
+		unsigned char* get_pixels(size_t index);
+		void set_label(size_t index, size_t label);
+
+		size_t size() const;
+		size_t width() const;
+		size_t height() const;
+		size_t channels() const;
+		size_t num_labels() const;
+
+		size_t get_label(size_t index) const;
+		const unsigned char* get_pixels(size_t index) const;
+		const unsigned char* data() const; // all samples, size() * sample_size() bytes
+	};
+
+	// MNIST/EMNIST served straight from memory-mapped idx files, nothing is copied at load time
+	class mapped_mnist_dataset : public image_dataset
+	{
+	private:
+		struct source
+		{
+			file::mapped_file images, labels;
+			size_t count;
+		};
+
+		std::vector<source> sources;
+		size_t total = 0, image_w = 0, image_h = 0, largest_label = 0;
+
+		const source& locate(size_t& index) const; // index becomes the index inside the returned source
+
+	public:
+		mapped_mnist_dataset() {}
+		mapped_mnist_dataset(std::string data_path, std::string label_path);
+
+		void add_source(std::string data_path, std::string label_path); // every source must have the same image size
+
+		size_t size() const;
+		size_t width() const;
+		size_t height() const;
+		size_t channels() const; // 1
+		size_t num_labels() const; // largest label + 1
+
+		size_t get_label(size_t index) const;
+		const unsigned char* get_pixels(size_t index) const;
+	};
+
+	// CIFAR-10 binary batches served straight from memory-mapped files
+	// NOTE: pixels are in file order (row-major), cifar10_dataset stores its tensors transposed
+	class mapped_cifar10_dataset : public image_dataset
+	{
+	private:
+		std::vector<file::mapped_file> sources; // 10000 records each
+
+		const unsigned char* record(size_t index) const;
+
+	public:
+		mapped_cifar10_dataset() {}
+		mapped_cifar10_dataset(std::string file_path);
+
+		void add_source(std::string file_path);
+
+		size_t size() const;
+		size_t width() const; // 32
+		size_t height() const; // 32
+		size_t channels() const; // 3
+		size_t num_labels() const; // 10
+
+		size_t get_label(size_t index) const;
+		const unsigned char* get_pixels(size_t index) const;
+	};
+
+	//== preprocessed dataset cache
+
+	// float samples and one-hot targets written once by write(), then memory-mapped on later runs: opening a cache only
+	// checks its header, pages are loaded on first access. usage:
+	//     if (!cached_dataset::check(path)) cached_dataset::write(path, parsed_dataset);
+	//     cached_dataset data(path);
+	// file layout (version 1, little-endian): header, then 64-byte aligned blocks of
+	// samples (size * input_size floats), labels (size uint32) and targets (size * target_size floats)
+	class cached_dataset : public batch_source
+	{
+	public:
+		static constexpr unsigned int version = 1;
+
+		struct header
+		{
+			char magic[8]; // "NNCACHE\0"
+			uint32_t version;
+			uint32_t header_size; // sizeof(header)
+			uint64_t count, input_size, target_size;
+			uint64_t width, height, channels; // sample shape, (input_size, 1, 1) if the source isn't an image_dataset
+			uint64_t samples_offset, labels_offset, targets_offset; // bytes from the start of the file, 64-byte aligned
+			uint64_t file_size;
+		};
+
+	private:
+		file::mapped_file file;
+		const header* info;
+		const float* samples;
+		const uint32_t* labels;
+		const float* targets;
+
+		static const char* validate(const file::mapped_file& file); // error message, nullptr if usable
+
+	public:
+		cached_dataset(std::string path); // throws logic_exception if the file is missing, damaged or of another version
+
+		// preprocess every sample of src into a cache file, replacing path. labels are the argmax of the targets
+		// return true if success
+		static bool write(std::string path, const batch_source& src);
+		static bool check(std::string path); // true if path holds a cache this build can open
+
+		size_t size() const;
+		size_t input_size() const;
+		size_t target_size() const;
+		size_t width() const;
+		size_t height() const;
+		size_t channels() const;
+
+		size_t get_label(size_t index) const;
+		const float* get_sample(size_t index) const; // input_size() floats, 64-byte aligned if input_size() is a multiple of 16
+		const float* get_target(size_t index) const; // target_size() floats
+
+		void fill_batch(const size_t* indices, size_t n, float* inputs, float* targets) const; // memcpy of each row
 	};
 
 	//== Inline function for template struct: nn_data
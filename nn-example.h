@@ -6,6 +6,10 @@
 #ifdef ENABLE_NN_EXAMPLES
 
 #include "nn-layer.h"
+#include "nn-model.h"
+#include "nn-inference.h"
+
+#include <memory>
 
 namespace nn::examples
 {
@@ -23,6 +27,51 @@ namespace nn::examples
 		update_weights();
 	}
 
+	==[TRAIN, MINI-BATCH]==
+
+	load_dataset();
+	for_each_batch:
+	{
+		feed_batch([inputs, one sample per row]); // rows are stride() floats apart, fill them through row(b) or copy_from
+		forward_and_grad_batch([targets, one sample per row]);
+		backward_batch();
+		update_weights_batch(); // one update per batch
+	}
+
+	==[TRAIN, DATA-PARALLEL]== (nn-parallel.h)
+
+	data_parallel_trainer<network> trainer(net);
+	for_each_batch:
+	{
+		trainer.train_batch([inputs], [targets]); // shards run on the thread pool, one update per batch
+	}
+
+	==[SAVE & RESTORE]== (nn-model.h)
+
+	save_model([path]); // after training
+	load_model([path]); // copy weights, training can continue
+	map_model([path]); // OR: serve straight from the mapped file, no copy, inference only
+
+	==[CHECKPOINT & RESUME]== (nn-checkpoint.h)
+
+	checkpoint_writer writer;
+	every_n_batches: writer.save([path], net, [step], loader.get_sampler_state()); // memcpy only, written in background
+	resume: auto state = load_checkpoint([path], net); loader.set_sampler_state(state.sampler_state); // picks up mid-epoch, after the last saved batch
+
+	==[SERVE]== (nn-inference.h)
+
+	inference_engine engine = net.compile(); // or mnist_network::compile_model([path]), weights mapped in place
+	from_any_thread: engine.predict([inputs, one sample per row]); // one GEMM per layer for the whole batch
+	OR, single-sample requests (nn-scheduler.h):
+	batch_scheduler scheduler(engine, options); // queued requests are run together
+	from_any_thread: scheduler.submit([input]).get();
+
+	==[CONV STACK, SHARED ACTIVATIONS]== (nn-planner.h)
+
+	memory_planner planner(memory_planner::mode::inference); // or training: keeps what backward needs
+	planner.add(conv); planner.add(relu); planner.add(pool); planner.add(adapter); // forward order
+	planner.bind(); // maps now share one arena, forward as usual
+
 	==[VERIFY]==
 
 	load_dataset();
@@ -46,9 +95,11 @@ namespace nn::examples
 
 		const nn::activate_func* func = new nn::leaky_relu_func();
 
+		std::unique_ptr<nn::model::model_file> mapped_model; // set by map_model, the layers' weights point into it
+
 		void feed_data(const nn::matrix& data)
 		{
-			input.push_input(data.to_vector());
+			input.push_input(data);
 		}
 
 		nn::vector& get_output()
@@ -94,6 +145,109 @@ namespace nn::examples
 			linear.rand_weights(min, max);
 			linear2.rand_weights(min, max);
 		}
+
+		void feed_batch(const nn::matrix& inputs)
+		{
+			input.push_batch(inputs);
+		}
+
+		nn::matrix& get_batch_output()
+		{
+			return softmax.get_batch_output();
+		}
+
+		void forward_and_grad_batch(const nn::matrix& targets)
+		{
+			softmax.push_target_batch(targets);
+
+			linear.forward_batch(&input, func);
+			linear2.forward_batch(&linear, func);
+			softmax.forward_and_grad_batch(&linear2);
+		}
+
+		void backward_batch()
+		{
+			linear2.backward_batch(&softmax);
+			linear.backward_batch(&linear2);
+		}
+
+		void forward_batch()
+		{
+			linear.forward_batch(&input, func);
+			linear2.forward_batch(&linear, func);
+			softmax.forward_batch(&linear2);
+		}
+
+		void update_weights_batch()
+		{
+			linear.update_weights_batch(&input, func, learning_rate);
+			linear2.update_weights_batch(&linear, func, learning_rate);
+		}
+
+		void accumulate_gradients_batch()
+		{
+			linear.accumulate_gradients_batch(&input, func);
+			linear2.accumulate_gradients_batch(&linear, func);
+		}
+
+		void apply_gradients(float scale)
+		{
+			linear.apply_gradients(learning_rate, scale);
+			linear2.apply_gradients(learning_rate, scale);
+		}
+
+		void get_parameters(std::vector<nn::parameter_block>& blocks)
+		{
+			linear.get_parameters(blocks);
+			linear2.get_parameters(blocks);
+		}
+
+		bool save_model(std::string path)
+		{
+			nn::model::model_writer writer(path);
+			writer.add(linear);
+			writer.add(linear2);
+			return writer.commit();
+		}
+
+		void load_model(std::string path)
+		{
+			nn::model::model_file file(path);
+			file.load(0, linear);
+			file.load(1, linear2);
+		}
+
+		void map_model(std::string path)
+		{
+			auto file = std::make_unique<nn::model::model_file>(path);
+			file->map(0, linear);
+			file->map(1, linear2);
+			mapped_model = std::move(file); // a previous mapping is released only now, after the layers moved off it
+		}
+
+		// read-only engine with a copy of the current weights, the network itself can keep training
+		nn::inference_engine compile()
+		{
+			nn::inference_engine engine;
+			engine.add_linear(linear, func);
+			engine.add_linear(linear2, func);
+			engine.set_output(nn::inference_engine::output_type::softmax);
+			return engine;
+		}
+
+		// engine straight from a model file written by save_model, weights are used in place from the mapping
+		static nn::inference_engine compile_model(std::string path)
+		{
+			static const nn::leaky_relu_func model_func;
+
+			auto model = std::make_shared<const nn::model::model_file>(path);
+
+			nn::inference_engine engine;
+			engine.add_linear(model, 0, &model_func);
+			engine.add_linear(model, 1, &model_func);
+			engine.set_output(nn::inference_engine::output_type::softmax);
+			return engine;
+		}
 	};
 }
 
@@ -2,6 +2,18 @@
 #include "nn-exception.h"
 
 #include <fstream>
+#include <algorithm>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 namespace fs = std::filesystem;
 
@@ -110,3 +122,211 @@ nn::file::file_binary_data::~file_binary_data()
 {
     delete[] data;
 }
+
+nn::file::mapped_file::mapped_file() :map_data(nullptr), map_size(0), map_valid(false)
+{
+}
+
+nn::file::mapped_file::mapped_file(std::string path) :map_data(nullptr), map_size(0), map_valid(false)
+{
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        throw logic_exception("can't open file", __FUNCTION__, __LINE__);
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size))
+    {
+        CloseHandle(file);
+        throw logic_exception("can't get file size", __FUNCTION__, __LINE__);
+    }
+
+    map_size = static_cast<size_t>(size.QuadPart);
+
+    if (map_size != 0) // empty files can't be mapped
+    {
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping == nullptr)
+        {
+            CloseHandle(file);
+            throw logic_exception("can't map file", __FUNCTION__, __LINE__);
+        }
+
+        map_data = static_cast<const unsigned char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+
+        // the view keeps the mapping and the file alive
+        CloseHandle(mapping);
+
+        if (map_data == nullptr)
+        {
+            CloseHandle(file);
+            throw logic_exception("can't map file", __FUNCTION__, __LINE__);
+        }
+    }
+
+    CloseHandle(file);
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw logic_exception("can't open file", __FUNCTION__, __LINE__);
+
+    struct stat info;
+    if (fstat(fd, &info) != 0)
+    {
+        ::close(fd);
+        throw logic_exception("can't get file size", __FUNCTION__, __LINE__);
+    }
+
+    map_size = static_cast<size_t>(info.st_size);
+
+    if (map_size != 0) // empty files can't be mapped
+    {
+        void* ptr = mmap(nullptr, map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (ptr == MAP_FAILED)
+        {
+            ::close(fd);
+            throw logic_exception("can't map file", __FUNCTION__, __LINE__);
+        }
+
+        map_data = static_cast<const unsigned char*>(ptr);
+    }
+
+    // the mapping keeps the file alive
+    ::close(fd);
+#endif
+
+    map_valid = true;
+}
+
+nn::file::mapped_file::mapped_file(mapped_file&& src) noexcept :map_data(src.map_data), map_size(src.map_size), map_valid(src.map_valid)
+{
+    src.map_data = nullptr;
+    src.map_size = 0;
+    src.map_valid = false;
+}
+
+nn::file::mapped_file::~mapped_file()
+{
+    close();
+}
+
+nn::file::mapped_file& nn::file::mapped_file::operator=(mapped_file&& src) noexcept
+{
+    if (this == &src)
+        return *this;
+
+    close();
+
+    map_data = src.map_data;
+    map_size = src.map_size;
+    map_valid = src.map_valid;
+
+    src.map_data = nullptr;
+    src.map_size = 0;
+    src.map_valid = false;
+
+    return *this;
+}
+
+bool nn::file::mapped_file::valid() const
+{
+    return map_valid;
+}
+
+const unsigned char* nn::file::mapped_file::data() const
+{
+    return map_data;
+}
+
+size_t nn::file::mapped_file::size() const
+{
+    return map_size;
+}
+
+void nn::file::mapped_file::close()
+{
+    if (map_data != nullptr)
+    {
+#ifdef _WIN32
+        UnmapViewOfFile(map_data);
+#else
+        munmap(const_cast<unsigned char*>(map_data), map_size);
+#endif
+    }
+
+    map_data = nullptr;
+    map_size = 0;
+    map_valid = false;
+}
+
+nn::file::binary_writer::binary_writer(std::string path) :path(path), written(0)
+{
+    stream.open(path + ".tmp", std::ios::binary | std::ios::trunc);
+
+    if (!stream.is_open())
+        throw logic_exception("can't create file", __FUNCTION__, __LINE__);
+}
+
+nn::file::binary_writer::~binary_writer()
+{
+    if (stream.is_open())
+    {
+        stream.close();
+
+        std::error_code error;
+        fs::remove(fs::path(path + ".tmp"), error);
+    }
+}
+
+void nn::file::binary_writer::write(const void* data, size_t size)
+{
+    stream.write(static_cast<const char*>(data), size);
+    written += size;
+}
+
+void nn::file::binary_writer::pad_to(size_t alignment)
+{
+    static const char zeros[64] = {};
+
+    while (written % alignment != 0)
+        write(zeros, std::min(alignment - written % alignment, sizeof(zeros)));
+}
+
+void nn::file::binary_writer::write_at(size_t offset, const void* data, size_t size)
+{
+    if (offset + size > written)
+        throw logic_exception("writing past the end of written data", __FUNCTION__, __LINE__);
+
+    stream.seekp(offset);
+    stream.write(static_cast<const char*>(data), size);
+    stream.seekp(written);
+}
+
+size_t nn::file::binary_writer::position() const
+{
+    return written;
+}
+
+bool nn::file::binary_writer::commit()
+{
+    if (!stream.is_open())
+        return false;
+
+    stream.flush();
+    stream.close(); // sets failbit if the last write can't be completed
+    const bool good = !stream.fail();
+
+    // rename replaces an existing file in one step, the old file stays intact until then
+    std::error_code error;
+    if (good)
+        fs::rename(fs::path(path + ".tmp"), fs::path(path), error);
+
+    if (!good || error)
+    {
+        std::error_code ignored;
+        fs::remove(fs::path(path + ".tmp"), ignored);
+        return false;
+    }
+
+    return true;
+}
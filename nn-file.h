@@ -7,6 +7,7 @@
 
 #include <string>
 #include <filesystem>
+#include <fstream>
 
 namespace nn::file
 {
@@ -30,6 +31,56 @@ namespace nn::file
 
 	bool file_write_bytes(std::string path, file_binary_data data); // return true if success
 	bool file_write_string(std::string path, std::string content); // return true if success
+
+	// read-only memory mapping of a whole file, pages are loaded by the os on first access
+	// the mapping stays valid until the object is destroyed or closed. not copyable, movable
+	class mapped_file
+	{
+	private:
+		const unsigned char* map_data;
+		size_t map_size;
+		bool map_valid;
+
+	public:
+		mapped_file();
+		mapped_file(std::string path); // throws logic_exception if the file can't be opened or mapped
+		mapped_file(const mapped_file& src) = delete;
+		mapped_file(mapped_file&& src) noexcept;
+		~mapped_file();
+
+		mapped_file& operator =(const mapped_file& src) = delete;
+		mapped_file& operator =(mapped_file&& src) noexcept;
+
+		bool valid() const;
+		const unsigned char* data() const; // nullptr for empty files
+		size_t size() const;
+
+		void close();
+	};
+
+	// streaming binary writer for large files, writes to path + ".tmp" and replaces path on commit()
+	// an interrupted or failed write never leaves a truncated file under the final name
+	class binary_writer
+	{
+	private:
+		std::string path;
+		std::ofstream stream;
+		size_t written;
+
+	public:
+		binary_writer(std::string path); // throws logic_exception if the temporary file can't be created
+		binary_writer(const binary_writer& src) = delete;
+		~binary_writer(); // removes the temporary file if not committed
+
+		binary_writer& operator =(const binary_writer& src) = delete;
+
+		void write(const void* data, size_t size);
+		void pad_to(size_t alignment); // zero bytes until position() is a multiple of alignment
+		void write_at(size_t offset, const void* data, size_t size); // overwrite bytes already written, eg. a header
+		size_t position() const; // bytes written so far
+
+		bool commit(); // flush and move the file to its final name, return true if success
+	};
 }
 
 #endif
\ No newline at end of file
@@ -8,8 +8,16 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb-img/stb_image.h"
 
+#define STB_IMAGE_RESIZE_STATIC
+#define STB_IMAGE_RESIZE_IMPLEMENTATION
+#include "stb-img/stb_image_resize.h"
+
 #include "nn-image.h"
 
+#include <filesystem>
+#include <algorithm>
+#include <cctype>
+
 nn::matrix nn::image::image_load_matrix(std::string path)
 {
 	int x, y, comp;
@@ -19,10 +27,10 @@ nn::matrix nn::image::image_load_matrix(std::string path)
 
 	matrix m(x, y);
 
-	for (size_t i = 0; i < static_cast<size_t>(x) * y; i++)
-	{
-		m.data()[i] = data[i] / 255.0f;
-	}
+	m.for_each([x, data](size_t px, size_t py, float& num)
+		{
+			num = data[py * x + px] / 255.0f;
+		});
 
 	free(data);
 
@@ -74,3 +82,145 @@ void nn::image::image_save_matrix_jpg(const matrix& src, std::string path, int q
 
 	stbi_write_jpg(path.c_str(), static_cast<int>(src.width()), static_cast<int>(src.height()), 1, dat.get(), quality);
 }
+
+//== image_folder_dataset
+
+namespace image_helper
+{
+	namespace fs = std::filesystem;
+
+	// extensions stb_image decodes
+	bool is_image_file(const fs::path& path)
+	{
+		static const char* extensions[] = { ".png", ".jpg", ".jpeg", ".bmp", ".tga", ".gif", ".psd", ".pgm", ".ppm", ".pnm" };
+
+		std::string ext = path.extension().string();
+		std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+
+		for (const char* e : extensions)
+			if (ext == e)
+				return true;
+
+		return false;
+	}
+
+	// sorted subdirectory names of root, one class each
+	std::vector<std::string> list_classes(const std::string& root)
+	{
+		std::error_code error;
+		if (!fs::is_directory(fs::path(root), error))
+			throw nn::logic_exception("can't open image folder", __FUNCTION__, __LINE__);
+
+		std::vector<std::string> classes;
+		for (auto& entry : fs::directory_iterator(fs::path(root)))
+			if (entry.is_directory())
+				classes.push_back(entry.path().filename().string());
+
+		if (classes.empty())
+			throw nn::logic_exception("image folder has no class directories", __FUNCTION__, __LINE__);
+
+		std::sort(classes.begin(), classes.end());
+		return classes;
+	}
+
+	// decode one image into dst: w * h * channels bytes, CHW. false if stb_image can't read the file
+	bool load_resized(const std::string& path, unsigned char* dst, size_t w, size_t h, size_t channels)
+	{
+		int iw, ih, comp;
+		unsigned char* img = stbi_load(path.c_str(), &iw, &ih, &comp, static_cast<int>(channels));
+		if (!img)
+			return false;
+
+		thread_local std::vector<unsigned char> resized;
+		const unsigned char* src = img;
+
+		if (static_cast<size_t>(iw) != w || static_cast<size_t>(ih) != h)
+		{
+			resized.resize(w * h * channels);
+			if (!stbir_resize_uint8(img, iw, ih, 0, resized.data(), static_cast<int>(w), static_cast<int>(h), 0, static_cast<int>(channels)))
+			{
+				stbi_image_free(img);
+				return false;
+			}
+			src = resized.data();
+		}
+
+		// interleaved (HWC) to planar (CHW)
+		for (size_t c = 0; c < channels; c++)
+			for (size_t i = 0; i < w * h; i++)
+				dst[c * w * h + i] = src[i * channels + c];
+
+		stbi_image_free(img);
+		return true;
+	}
+}
+
+nn::image::image_folder_dataset::image_folder_dataset(std::string root, size_t w, size_t h, size_t channels, thread_pool& pool)
+	:image_folder_dataset(image_helper::list_classes(root), root, w, h, channels, pool)
+{
+}
+
+nn::image::image_folder_dataset::image_folder_dataset(std::vector<std::string> classes, std::string root, size_t w, size_t h, size_t channels, thread_pool& pool)
+	:compact_dataset(w, h, channels, classes.size()), class_names(std::move(classes))
+{
+	if (channels != 1 && channels != 3 && channels != 4)
+		throw nn::numeric_exception("channels should be 1, 3 or 4", __FUNCTION__, __LINE__);
+
+	// file list, sorted inside each class so the sample order doesn't depend on the file system
+	std::vector<std::string> paths;
+	std::vector<size_t> path_labels;
+
+	for (size_t label = 0; label < class_names.size(); label++)
+	{
+		std::vector<std::string> files;
+		for (auto& entry : std::filesystem::directory_iterator(std::filesystem::path(root) / class_names[label]))
+			if (entry.is_regular_file() && image_helper::is_image_file(entry.path()))
+				files.push_back(entry.path().string());
+
+		std::sort(files.begin(), files.end());
+
+		paths.insert(paths.end(), files.begin(), files.end());
+		path_labels.insert(path_labels.end(), files.size(), label);
+	}
+
+	// every file decodes straight into its own slot
+	resize(paths.size());
+	std::vector<unsigned char> decoded(paths.size(), 0);
+
+	pool.parallel_for(0, paths.size(), [&](size_t i)
+		{
+			decoded[i] = image_helper::load_resized(paths[i], get_pixels(i), w, h, channels);
+			set_label(i, path_labels[i]);
+		});
+
+	// close the gaps left by files that failed
+	size_t count = 0;
+	for (size_t i = 0; i < paths.size(); i++)
+	{
+		if (!decoded[i])
+			continue;
+
+		if (count != i)
+		{
+			memcpy(get_pixels(count), get_pixels(i), sample_size());
+			set_label(count, path_labels[i]);
+		}
+		count++;
+	}
+
+	failed = paths.size() - count;
+	resize(count);
+}
+
+const std::string& nn::image::image_folder_dataset::get_class_name(size_t label) const
+{
+	if (label >= class_names.size())
+		throw nn::numeric_exception("label out of range", __FUNCTION__, __LINE__);
+
+	return class_names[label];
+}
+
+size_t nn::image::image_folder_dataset::num_failed() const
+{
+	return failed;
+}
@@ -2,7 +2,10 @@
 #define NN_IMAGE_H
 
 #include <string>
+#include <vector>
 #include "nn-math.h"
+#include "nn-dataset.h"
+#include "nn-thread.h"
 
 namespace nn::image
 {
@@ -14,6 +17,25 @@ namespace nn::image
 
 	nn::matrix image_upscale_matrix(const matrix& src, size_t scale_factor);
 	nn::tensor image_upscale_tensor(const tensor& src, size_t scale_factor);
+
+	// dataset from a directory-per-class layout: root/<class name>/<image files>, labels follow the sorted class names
+	// every image is decoded with stb_image on the thread pool, resized (stretched) to w * h and stored as 8-bit CHW in
+	// one contiguous buffer. files stb_image can't decode are skipped and counted
+	class image_folder_dataset : public compact_dataset
+	{
+	private:
+		std::vector<std::string> class_names;
+		size_t failed = 0;
+
+		image_folder_dataset(std::vector<std::string> classes, std::string root, size_t w, size_t h, size_t channels, thread_pool& pool);
+
+	public:
+		// channels: 1 (grey), 3 (rgb) or 4 (rgba), images are converted as needed
+		image_folder_dataset(std::string root, size_t w, size_t h, size_t channels = 3, thread_pool& pool = thread_pool::global());
+
+		const std::string& get_class_name(size_t label) const;
+		size_t num_failed() const; // files skipped because they couldn't be decoded
+	};
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,164 @@
+#include "nn-inference.h"
+#include "nn-exception.h"
+
+#include <cmath>
+#include <algorithm>
+
+//== inference helper functions, local
+
+namespace inference_helper
+{
+	// row-wise softmax in place, same steps as softmax_optimizer::forward_batch
+	void softmax_rows(float* data, size_t rows, size_t width, size_t stride)
+	{
+		for (size_t b = 0; b < rows; b++)
+		{
+			float* row = data + b * stride;
+
+			float max = row[0];
+			for (size_t i = 1; i < width; i++)
+				if (row[i] > max) max = row[i];
+
+			float sum = 0.0f;
+			for (size_t i = 0; i < width; i++)
+			{
+				row[i] = exp(row[i] - max);
+				sum += row[i];
+			}
+
+			for (size_t i = 0; i < width; i++)
+				row[i] /= sum;
+		}
+	}
+}
+
+void nn::inference_engine::push_layer(const float* weights, size_t inputs, size_t outputs, float bias, const activate_func* func)
+{
+	if (func == nullptr)
+		throw logic_exception("activation function is null", __FUNCTION__, __LINE__);
+	if (!layers.empty() && layers.back().outputs != inputs)
+		throw logic_exception("layer size mismatch", __FUNCTION__, __LINE__);
+
+	layers.push_back({ weights, inputs, outputs, bias, func });
+}
+
+void nn::inference_engine::add_linear(hidden_layer::linear_layer& layer, const activate_func* func)
+{
+	const matrix& weights = layer.get_weights();
+	std::unique_ptr<float[]> copy(new float[weights.width() * weights.height()]);
+	weights.copy_to(copy.get()); // dense rows
+
+	push_layer(copy.get(), weights.width(), weights.height(), layer.get_bias(), func);
+	owned_weights.push_back(std::move(copy));
+}
+
+void nn::inference_engine::add_linear(std::shared_ptr<const model::model_file> model, size_t index, const activate_func* func)
+{
+	const model::layer_entry& entry = model->get_entry(index);
+	if (entry.type != static_cast<uint32_t>(model::layer_type::linear))
+		throw logic_exception("layer type mismatch", __FUNCTION__, __LINE__);
+
+	const size_t outputs = entry.shape[0], inputs = entry.shape[1];
+	const float* data = model->get_data(index);
+
+	push_layer(data, inputs, outputs, data[outputs * inputs], func);
+
+	if (std::find(models.begin(), models.end(), model) == models.end())
+		models.push_back(std::move(model));
+}
+
+void nn::inference_engine::set_output(output_type type)
+{
+	output = type;
+}
+
+size_t nn::inference_engine::input_size() const
+{
+	return layers.empty() ? 0 : layers.front().inputs;
+}
+
+size_t nn::inference_engine::output_size() const
+{
+	return layers.empty() ? 0 : layers.back().outputs;
+}
+
+void nn::inference_engine::predict(const float* inputs, size_t n, float* outputs) const
+{
+	predict(inputs, input_size(), n, outputs, output_size());
+}
+
+void nn::inference_engine::predict(const float* inputs, size_t input_stride, size_t n, float* outputs, size_t output_stride) const
+{
+	if (layers.empty())
+		throw logic_exception("engine has no layers", __FUNCTION__, __LINE__);
+	if (n == 0)
+		return;
+
+	// activations ping-pong between two per-thread buffers, the last layer writes straight to outputs
+	thread_local std::vector<float> workspace[2];
+
+	const float* src = inputs;
+	size_t src_stride = input_stride;
+	for (size_t l = 0; l < layers.size(); l++)
+	{
+		const dense_layer& layer = layers[l];
+		float* dst = outputs;
+		size_t dst_stride = output_stride;
+
+		if (l + 1 < layers.size())
+		{
+			dst_stride = math::row_stride(layer.outputs); // padded like a matrix row
+			std::vector<float>& buffer = workspace[l % 2];
+			if (buffer.size() < n * dst_stride)
+				buffer.resize(n * dst_stride);
+			dst = buffer.data();
+		}
+
+		// dst(n*outputs) = src(n*inputs) * W^T, as in linear_layer::forward_batch
+		math::gemm(false, true, n, layer.outputs, layer.inputs, 1.0f, src, src_stride, layer.weights, layer.inputs, 0.0f, dst, dst_stride);
+
+		// whole rows including the padding between them, not past the last one
+		const size_t count = (n - 1) * dst_stride + layer.outputs;
+		math::add(dst, layer.bias, count);
+		layer.func->forward(dst, dst, count);
+
+		src = dst;
+		src_stride = dst_stride;
+	}
+
+	if (output == output_type::softmax)
+		inference_helper::softmax_rows(outputs, n, output_size(), output_stride);
+}
+
+nn::matrix nn::inference_engine::predict(const matrix& inputs) const
+{
+	if (inputs.width() != input_size())
+		throw logic_exception("input size mismatch", __FUNCTION__, __LINE__);
+
+	matrix outputs(output_size(), inputs.height());
+	predict(inputs.data(), inputs.stride(), inputs.height(), outputs.data(), outputs.stride());
+	return outputs;
+}
+
+nn::matrix nn::inference_engine::predict_parallel(const matrix& inputs, thread_pool& pool, size_t grain) const
+{
+	if (inputs.width() != input_size())
+		throw logic_exception("input size mismatch", __FUNCTION__, __LINE__);
+
+	const size_t n = inputs.height();
+	matrix outputs(output_size(), n);
+	if (n == 0)
+		return outputs;
+
+	// one chunk per thread (caller included) unless that would go below grain rows
+	grain = std::max<size_t>(grain, 1);
+	const size_t chunks = std::max<size_t>(1, std::min(pool.size() + 1, n / grain));
+
+	pool.parallel_for(0, chunks, [&](size_t c)
+		{
+			const size_t first = n * c / chunks, last = n * (c + 1) / chunks;
+			predict(inputs.row(first), inputs.stride(), last - first, outputs.row(first), outputs.stride());
+		});
+
+	return outputs;
+}
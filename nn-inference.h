@@ -0,0 +1,71 @@
+// FILENAME: nn-inference.h
+// Read-only inference engine for serving: immutable weights shared by every thread, activations in per-thread workspaces
+// A batch of N inputs goes through each layer as one GEMM, so concurrent requests never touch shared mutable state
+
+#ifndef NN_INFERENCE_H
+#define NN_INFERENCE_H
+
+#include "nn-layer.h"
+#include "nn-model.h"
+#include "nn-thread.h"
+
+#include <vector>
+#include <memory>
+
+namespace nn
+{
+	class inference_engine
+	{
+	public:
+		enum class output_type
+		{
+			raw, // activated values of the last layer
+			softmax // softmax over each output row, same as softmax_optimizer
+		};
+
+	private:
+		struct dense_layer
+		{
+			const float* weights; // outputs rows of inputs floats
+			size_t inputs, outputs;
+			float bias;
+			const activate_func* func;
+		};
+
+		std::vector<dense_layer> layers;
+		std::vector<std::unique_ptr<float[]>> owned_weights; // copies made by add_linear(layer)
+		std::vector<std::shared_ptr<const model::model_file>> models; // mapped files referenced by layers
+		output_type output = output_type::raw;
+
+		void push_layer(const float* weights, size_t inputs, size_t outputs, float bias, const activate_func* func);
+		void predict(const float* inputs, size_t input_stride, size_t n, float* outputs, size_t output_stride) const; // rows stride floats apart
+
+	public:
+		inference_engine() {}
+		inference_engine(const inference_engine&) = delete;
+		inference_engine(inference_engine&&) = default;
+
+		inference_engine& operator =(const inference_engine&) = delete;
+		inference_engine& operator =(inference_engine&&) = default;
+
+		//== building, not thread safe. func must outlive the engine
+
+		void add_linear(hidden_layer::linear_layer& layer, const activate_func* func); // copies the weights
+		void add_linear(std::shared_ptr<const model::model_file> model, size_t index, const activate_func* func); // weights used in place
+		void set_output(output_type type);
+
+		//== inference, safe to call from any number of threads at once
+
+		size_t input_size() const;
+		size_t output_size() const;
+
+		// inputs: n rows of input_size() floats, outputs: n rows of output_size() floats
+		void predict(const float* inputs, size_t n, float* outputs) const;
+		matrix predict(const matrix& inputs) const; // one sample per row
+
+		// rows split into chunks of at least grain samples over the pool, one GEMM pass per chunk and layer
+		matrix predict_parallel(const matrix& inputs, thread_pool& pool = thread_pool::global(), size_t grain = 32) const;
+	};
+}
+
+#endif
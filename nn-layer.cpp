@@ -1,6 +1,7 @@
 #include "nn-layer.h"
 
 #include <math.h>
+#include <cstring>
 
 nn::input_layer::vector_input::vector_input(size_t size)
 {
@@ -16,11 +17,37 @@ void nn::input_layer::vector_input::push_input(const vector& data)
 	input = data;
 }
 
+void nn::input_layer::vector_input::push_input(const matrix& data)
+{
+	if (data.width() * data.height() != input_size)
+		throw nn::logic_exception("matrix size mismatch!", __FUNCTION__, __LINE__);
+
+	data.copy_to(input.data());
+}
+
+void nn::input_layer::vector_input::push_batch(const matrix& data)
+{
+	if (data.width() != input_size)
+		throw nn::logic_exception("vector size mismatch!", __FUNCTION__, __LINE__);
+
+	batch_input = data; // only re-allocates if the batch size changes
+}
+
 nn::vector& nn::input_layer::vector_input::get_input()
 {
 	return input;
 }
 
+nn::matrix& nn::input_layer::vector_input::get_batch()
+{
+	return batch_input;
+}
+
+size_t nn::input_layer::vector_input::get_batch_size()
+{
+	return batch_input.height();
+}
+
 size_t nn::input_layer::vector_input::get_size()
 {
 	return input_size;
@@ -59,6 +86,38 @@ void nn::optimizer::mse_optimizer::forward(hidden_layer::linear_layer* layer)
 	output = layer->get_value();
 }
 
+void nn::optimizer::mse_optimizer::forward_and_grad_batch(hidden_layer::linear_layer* layer)
+{
+	forward_batch(layer);
+
+	if (batch_target.width() != optimizer_size || batch_target.height() != batch_output.height())
+		throw nn::logic_exception("target batch size mismatch!", __FUNCTION__, __LINE__);
+
+	loss = 0.0f;
+
+	for (size_t b = 0; b < batch_output.height(); b++)
+	{
+		const float* out = batch_output.row(b);
+		const float* tgt = batch_target.row(b);
+		float* grad = batch_gradient.row(b);
+
+		for (size_t i = 0; i < optimizer_size; i++)
+		{
+			grad[i] = tgt[i] - out[i];
+			loss += grad[i] * grad[i];
+		}
+	}
+
+	loss /= batch_output.height();
+}
+
+void nn::optimizer::mse_optimizer::forward_batch(hidden_layer::linear_layer* layer)
+{
+	check_batch(layer);
+
+	batch_output = layer->get_batch_value();
+}
+
 nn::vector& nn::optimizer::vector_optimizer::get_gradient()
 {
 	return gradient;
@@ -87,6 +146,38 @@ void nn::optimizer::vector_optimizer::push_target(const vector& target)
 	this->target = target;
 }
 
+nn::matrix& nn::optimizer::vector_optimizer::get_batch_gradient()
+{
+	return batch_gradient;
+}
+
+nn::matrix& nn::optimizer::vector_optimizer::get_batch_output()
+{
+	return batch_output;
+}
+
+void nn::optimizer::vector_optimizer::push_target_batch(const matrix& targets)
+{
+	if (targets.width() != optimizer_size)
+		throw nn::logic_exception("vector size mismatch!", __FUNCTION__, __LINE__);
+
+	batch_target = targets;
+}
+
+void nn::optimizer::vector_optimizer::check_batch(hidden_layer::linear_layer* layer)
+{
+	if (layer->get_size() != optimizer_size)
+		throw nn::logic_exception("vector size mismatch!", __FUNCTION__, __LINE__);
+
+	size_t batch_size = layer->get_batch_value().height();
+
+	if (batch_output.height() != batch_size || batch_output.width() != optimizer_size)
+	{
+		batch_output = matrix(optimizer_size, batch_size);
+		batch_gradient = matrix(optimizer_size, batch_size);
+	}
+}
+
 nn::optimizer::softmax_optimizer::softmax_optimizer(size_t size)
 {
 	optimizer_size = size;
@@ -131,16 +222,81 @@ void nn::optimizer::softmax_optimizer::forward(hidden_layer::linear_layer* layer
 	output /= output.sum();
 }
 
+void nn::optimizer::softmax_optimizer::forward_and_grad_batch(hidden_layer::linear_layer* layer)
+{
+	forward_batch(layer);
+
+	if (batch_target.width() != optimizer_size || batch_target.height() != batch_output.height())
+		throw nn::logic_exception("target batch size mismatch!", __FUNCTION__, __LINE__);
+
+	loss = 0.0f;
+
+	for (size_t b = 0; b < batch_output.height(); b++)
+	{
+		const float* out = batch_output.row(b);
+		const float* tgt = batch_target.row(b);
+		float* grad = batch_gradient.row(b);
+
+		for (size_t i = 0; i < optimizer_size; i++)
+		{
+			grad[i] = tgt[i] - out[i];
+			loss += -tgt[i] * log(out[i]);
+		}
+	}
+
+	loss /= batch_output.height();
+}
+
+void nn::optimizer::softmax_optimizer::forward_batch(hidden_layer::linear_layer* layer)
+{
+	check_batch(layer);
+
+	const matrix& in = layer->get_batch_value();
+
+	// do softmax per sample (row)
+	for (size_t b = 0; b < in.height(); b++)
+	{
+		const float* src = in.row(b);
+		float* dst = batch_output.row(b);
+
+		float max = src[0];
+		for (size_t i = 1; i < optimizer_size; i++)
+			if (src[i] > max) max = src[i];
+
+		float sum = 0.0f;
+		for (size_t i = 0; i < optimizer_size; i++)
+		{
+			dst[i] = exp(src[i] - max);
+			sum += dst[i];
+		}
+
+		for (size_t i = 0; i < optimizer_size; i++)
+			dst[i] /= sum;
+	}
+}
+
 nn::hidden_layer::linear_layer::linear_layer(size_t size, size_t weight_size)
 {
 	num_weights = weight_size;
 	num_neurons = size;
 
-	weights.resize(size, vector(weight_size));
+	weights = matrix(weight_size, size);
 	value = vector(size); value.fill(0.0f);
-	gradient = vector(size); value.fill(0.0f);
+	gradient = vector(size); gradient.fill(0.0f);
+	delta = vector(size);
 
+	weight_gradient = matrix(weight_size, size); weight_gradient.fill(0.0f);
 	bias = 0.0f;
+	bias_gradient = 0.0f;
+}
+
+void nn::hidden_layer::linear_layer::forward_from(const vector& input, const activate_func* func)
+{
+	// value = W * input, then activate each neuron
+	math::gemv(false, num_neurons, num_weights, 1.0f, weights.data(), weights.stride(), input.data(), 0.0f, value.data());
+
+	math::add(value.data(), bias, num_neurons);
+	func->forward(value.data(), value.data(), num_neurons);
 }
 
 void nn::hidden_layer::linear_layer::forward(input_layer::vector_input* prev, const activate_func* func)
@@ -148,11 +304,7 @@ void nn::hidden_layer::linear_layer::forward(input_layer::vector_input* prev, co
 	if (prev->get_size() != num_weights)
 		throw logic_exception("size mismatch!", __FUNCTION__, __LINE__);
 
-	value.for_each([this, prev, func](size_t idx, float& num)
-		{
-			auto& input = prev->get_input();
-			num = func->forward(nn::vector::dot(input, weights[idx]) + bias);
-		});
+	forward_from(prev->get_input(), func);
 }
 
 void nn::hidden_layer::linear_layer::forward(linear_layer* prev, const activate_func* func)
@@ -160,10 +312,7 @@ void nn::hidden_layer::linear_layer::forward(linear_layer* prev, const activate_
 	if (prev->get_size() != num_weights)
 		throw logic_exception("size mismatch!", __FUNCTION__, __LINE__);
 
-	value.for_each([this, &prev, func](size_t idx, float& num)
-		{
-			num = func->forward(nn::vector::dot(prev->get_value(), weights[idx]) + bias);
-		});
+	forward_from(prev->get_value(), func);
 }
 
 void nn::hidden_layer::linear_layer::forward(conv2_linear_adapter_layer* prev, const activate_func* func)
@@ -171,10 +320,7 @@ void nn::hidden_layer::linear_layer::forward(conv2_linear_adapter_layer* prev, c
 	if(prev->size != num_weights)
 		throw logic_exception("size mismatch!", __FUNCTION__, __LINE__);
 
-	value.for_each([this, &prev, func](size_t idx, float& num)
-		{
-			num = func->forward(nn::vector::dot(prev->get_value(), weights[idx]) + bias);
-		});
+	forward_from(prev->get_value(), func);
 }
 
 void nn::hidden_layer::linear_layer::backward(optimizer::vector_optimizer* optimizer)
@@ -187,45 +333,155 @@ void nn::hidden_layer::linear_layer::backward(optimizer::vector_optimizer* optim
 
 void nn::hidden_layer::linear_layer::backward(linear_layer* last)
 {
-	gradient.for_each([this, last](size_t idx, float& num)
-		{
-			num = 0.0f;
+	if (last->num_weights != num_neurons)
+		throw logic_exception("size mismatch!", __FUNCTION__, __LINE__);
 
-			last->get_gradient().for_each([&num, idx, last](size_t idx2, float& num2)
-				{
-					num += last->get_weight(idx2)[idx] * num2;
-				});
-		});
+	// gradient = W(last)^T * gradient(last)
+	math::gemv(true, last->num_neurons, last->num_weights, 1.0f, last->weights.data(), last->weights.stride(), last->gradient.data(), 0.0f, gradient.data());
 }
 
-void nn::hidden_layer::linear_layer::update_weights(input_layer::vector_input* prev, const activate_func* func, float learning_rate)
+void nn::hidden_layer::linear_layer::check_trainable() const
+{
+	if (weights.is_view())
+		throw logic_exception("weights are mapped from a model file, inference only", __FUNCTION__, __LINE__);
+}
+
+void nn::hidden_layer::linear_layer::update_weights_from(const vector& input, const activate_func* func, float learning_rate)
 {
+	check_trainable();
+
+	func->backward(value.data(), delta.data(), num_neurons); // activation derivatives
+
 	for (size_t i = 0; i < num_neurons; i++)
 	{
 		bias += learning_rate * func->backward(bias) * gradient[i]; // update bias
-		float coeff = learning_rate * func->backward(value[i]) * gradient[i];
-		auto& weight = weights[i];
-
-		weight.for_each([coeff, prev](size_t idx, float& num) // update weights
-			{
-				num += coeff * prev->get_input()[idx];
-			});
+		delta[i] = learning_rate * delta[i] * gradient[i];
 	}
+
+	// update weights: W += delta * input^T
+	math::ger(num_neurons, num_weights, 1.0f, delta.data(), input.data(), weights.data(), weights.stride());
+}
+
+void nn::hidden_layer::linear_layer::update_weights(input_layer::vector_input* prev, const activate_func* func, float learning_rate)
+{
+	update_weights_from(prev->get_input(), func, learning_rate);
 }
 
 void nn::hidden_layer::linear_layer::update_weights(hidden_layer::linear_layer* prev, const activate_func* func, float learning_rate)
 {
-	for (size_t i = 0; i < num_neurons; i++)
+	update_weights_from(prev->get_value(), func, learning_rate);
+}
+
+void nn::hidden_layer::linear_layer::resize_batch(size_t batch_size)
+{
+	if (batch_value.height() == batch_size)
+		return;
+
+	batch_value = matrix(num_neurons, batch_size);
+	batch_gradient = matrix(num_neurons, batch_size);
+	batch_delta = matrix(num_neurons, batch_size);
+}
+
+void nn::hidden_layer::linear_layer::forward_batch_from(const matrix& input, const activate_func* func)
+{
+	if (input.width() != num_weights)
+		throw logic_exception("size mismatch!", __FUNCTION__, __LINE__);
+
+	resize_batch(input.height());
+
+	// value(batch*neurons) = input(batch*weights) * W^T
+	math::gemm(false, true, input.height(), num_neurons, num_weights, 1.0f, input.data(), input.stride(), weights.data(), weights.stride(), 0.0f, batch_value.data(), batch_value.stride());
+
+	// whole padded rows, no tail per sample
+	const size_t count = batch_value.stride() * input.height();
+	math::add(batch_value.data(), bias, count);
+	func->forward(batch_value.data(), batch_value.data(), count);
+}
+
+void nn::hidden_layer::linear_layer::forward_batch(input_layer::vector_input* prev, const activate_func* func)
+{
+	forward_batch_from(prev->get_batch(), func);
+}
+
+void nn::hidden_layer::linear_layer::forward_batch(linear_layer* prev, const activate_func* func)
+{
+	forward_batch_from(prev->batch_value, func);
+}
+
+void nn::hidden_layer::linear_layer::backward_batch(optimizer::vector_optimizer* optimizer)
+{
+	if (optimizer->get_size() != num_neurons || optimizer->get_batch_gradient().height() != batch_value.height())
+		throw logic_exception("size mismatch!", __FUNCTION__, __LINE__);
+
+	batch_gradient = optimizer->get_batch_gradient();
+}
+
+void nn::hidden_layer::linear_layer::backward_batch(linear_layer* last)
+{
+	if (last->num_weights != num_neurons || last->batch_gradient.height() != batch_value.height())
+		throw logic_exception("size mismatch!", __FUNCTION__, __LINE__);
+
+	// gradient(batch*neurons) = gradient(last)(batch*last_neurons) * W(last)
+	math::gemm(false, false, batch_value.height(), num_neurons, last->num_neurons, 1.0f, last->batch_gradient.data(), last->batch_gradient.stride(), last->weights.data(), last->weights.stride(), 0.0f, batch_gradient.data(), batch_gradient.stride());
+}
+
+void nn::hidden_layer::linear_layer::accumulate_gradients_from(const matrix& input, const activate_func* func)
+{
+	if (input.width() != num_weights || input.height() != batch_value.height())
+		throw logic_exception("size mismatch!", __FUNCTION__, __LINE__);
+
+	func->backward(batch_value.data(), batch_delta.data(), batch_value.stride() * input.height()); // activation derivatives, whole padded rows
+
+	float grad_sum = 0.0f;
+	for (size_t b = 0; b < input.height(); b++)
 	{
-		bias += learning_rate * func->backward(bias) * gradient[i]; // update bias
-		float coeff = learning_rate * func->backward(value[i]) * gradient[i];
-		auto& weight = weights[i];
+		const float* grad = batch_gradient.row(b);
+		float* del = batch_delta.row(b);
 
-		weight.for_each([coeff, prev](size_t idx, float& num) // update weights
-			{
-				num += coeff * prev->get_value()[idx];
-			});
+		for (size_t i = 0; i < num_neurons; i++)
+		{
+			del[i] *= grad[i];
+			grad_sum += grad[i];
+		}
 	}
+
+	bias_gradient += func->backward(bias) * grad_sum;
+
+	// weight_gradient(neurons*weights) += delta^T(neurons*batch) * input(batch*weights)
+	math::gemm(true, false, num_neurons, num_weights, input.height(), 1.0f, batch_delta.data(), batch_delta.stride(), input.data(), input.stride(), 1.0f, weight_gradient.data(), weight_gradient.stride());
+}
+
+void nn::hidden_layer::linear_layer::accumulate_gradients_batch(input_layer::vector_input* prev, const activate_func* func)
+{
+	accumulate_gradients_from(prev->get_batch(), func);
+}
+
+void nn::hidden_layer::linear_layer::accumulate_gradients_batch(linear_layer* prev, const activate_func* func)
+{
+	accumulate_gradients_from(prev->batch_value, func);
+}
+
+void nn::hidden_layer::linear_layer::apply_gradients(float learning_rate, float scale)
+{
+	check_trainable();
+
+	math::axpy(weights.data(), learning_rate * scale, weight_gradient.data(), weights.stride() * num_neurons); // whole padded rows, owned weights share the layout of the gradient
+	bias += learning_rate * scale * bias_gradient;
+
+	weight_gradient.fill(0.0f);
+	bias_gradient = 0.0f;
+}
+
+void nn::hidden_layer::linear_layer::update_weights_batch(input_layer::vector_input* prev, const activate_func* func, float learning_rate)
+{
+	accumulate_gradients_batch(prev, func);
+	apply_gradients(learning_rate, 1.0f / prev->get_batch_size());
+}
+
+void nn::hidden_layer::linear_layer::update_weights_batch(linear_layer* prev, const activate_func* func, float learning_rate)
+{
+	accumulate_gradients_batch(prev, func);
+	apply_gradients(learning_rate, 1.0f / prev->batch_value.height());
 }
 
 nn::vector& nn::hidden_layer::linear_layer::get_value()
@@ -238,9 +494,47 @@ nn::vector& nn::hidden_layer::linear_layer::get_gradient()
 	return gradient;
 }
 
-nn::vector& nn::hidden_layer::linear_layer::get_weight(size_t index)
+float* nn::hidden_layer::linear_layer::get_weight(size_t index)
+{
+	return weights.row(index);
+}
+
+nn::matrix& nn::hidden_layer::linear_layer::get_weights()
+{
+	return weights;
+}
+
+float& nn::hidden_layer::linear_layer::get_bias()
+{
+	return bias;
+}
+
+nn::matrix& nn::hidden_layer::linear_layer::get_batch_value()
+{
+	return batch_value;
+}
+
+nn::matrix& nn::hidden_layer::linear_layer::get_batch_gradient()
 {
-	return weights[index];
+	return batch_gradient;
+}
+
+nn::matrix& nn::hidden_layer::linear_layer::get_weight_gradient()
+{
+	return weight_gradient;
+}
+
+float& nn::hidden_layer::linear_layer::get_bias_gradient()
+{
+	return bias_gradient;
+}
+
+void nn::hidden_layer::linear_layer::get_parameters(std::vector<parameter_block>& blocks)
+{
+	check_trainable();
+
+	blocks.push_back({ weights.data(), weight_gradient.data(), weights.stride() * num_neurons }); // padding included
+	blocks.push_back({ &bias, &bias_gradient, 1 });
 }
 
 size_t nn::hidden_layer::linear_layer::get_size()
@@ -250,8 +544,9 @@ size_t nn::hidden_layer::linear_layer::get_size()
 
 void nn::hidden_layer::linear_layer::rand_weights(float min, float max)
 {
-	for (auto& weight : weights)
-		nn::math::rand_vector(weight, min, max);
+	check_trainable();
+
+	nn::math::rand_matrix(weights, min, max);
 
 	bias = nn::math::rand_float(min, max);
 }
@@ -268,12 +563,14 @@ nn::hidden_layer::conv2_layer::conv2_layer(size_t w, size_t h, size_t depth, siz
 
 void nn::hidden_layer::conv2_layer::forward(input_layer::matrix_input* prev)
 {
-	// do conv for each kernal
+	// all kernals share the same input: input tiles are transformed once (winograd), or one im2col pass + one gemm
+	if (use_winograd())
+		math::conv_2d_winograd(maps, prev->get_input(), get_winograd_kernals(), padding);
+	else
+		math::conv_2d(maps, prev->get_input(), kernals, stride, padding);
+
 	for (size_t i = 0; i < depth; i++)
-	{
-		math::conv_2d(maps[i], prev->get_input(), kernals[i], stride, padding);
 		maps[i] += bias[i];
-	}
 }
 
 void nn::hidden_layer::conv2_layer::forward(hidden_layer::conv2_layer* prev)
@@ -282,9 +579,14 @@ void nn::hidden_layer::conv2_layer::forward(hidden_layer::conv2_layer* prev)
 		throw numeric_exception("conv layer depth mismatch", __FUNCTION__, __LINE__);
 
 	// do conv for each kernal
+	const float* transformed = use_winograd() ? get_winograd_kernals() : nullptr;
+
 	for (size_t i = 0; i < depth; i++)
 	{
-		math::conv_2d(maps[i], prev->get_map(i), kernals[i], stride, padding);
+		if (transformed)
+			math::conv_2d_winograd(maps[i], prev->get_map(i), transformed + i * math::winograd_kernal_floats, padding);
+		else
+			math::conv_2d(maps[i], prev->get_map(i), kernals[i], stride, padding);
 	}
 }
 
@@ -294,17 +596,28 @@ void nn::hidden_layer::conv2_layer::forward(hidden_layer::relu_layer* prev)
 		throw numeric_exception("relu layer and conv layer depth mismatch", __FUNCTION__, __LINE__);
 
 	// do conv for each kernal
+	const float* transformed = use_winograd() ? get_winograd_kernals() : nullptr;
+
 	for (size_t i = 0; i < depth; i++)
 	{
-		math::conv_2d(maps[i], prev->get_map(i), kernals[i], stride, padding);
+		if (transformed)
+			math::conv_2d_winograd(maps[i], prev->get_map(i), transformed + i * math::winograd_kernal_floats, padding);
+		else
+			math::conv_2d(maps[i], prev->get_map(i), kernals[i], stride, padding);
 	}
 }
 
 nn::matrix& nn::hidden_layer::conv2_layer::get_kernal(size_t idx)
 {
+	winograd_valid = false;
 	return kernals[idx];
 }
 
+float& nn::hidden_layer::conv2_layer::get_bias(size_t idx)
+{
+	return bias[idx];
+}
+
 nn::matrix& nn::hidden_layer::conv2_layer::get_map(size_t idx)
 {
 	return maps[idx];
@@ -317,11 +630,47 @@ nn::matrix& nn::hidden_layer::conv2_layer::get_gradient(size_t idx)
 
 void nn::hidden_layer::conv2_layer::rand_weights(float min, float max)
 {
+	check_trainable();
+
 	for (size_t i = 0; i < depth; i++)
 	{
 		math::rand_matrix(kernals[i], min, max);
 		bias[i] = math::rand_float(min, max);
 	}
+
+	winograd_valid = false;
+}
+
+bool nn::hidden_layer::conv2_layer::use_winograd() const
+{
+	return kernal_size == 3 && stride == 1;
+}
+
+void nn::hidden_layer::conv2_layer::invalidate_kernals()
+{
+	winograd_valid = false;
+}
+
+void nn::hidden_layer::conv2_layer::check_trainable() const
+{
+	for (auto& k : kernals)
+		if (k.is_view())
+			throw logic_exception("kernals are mapped from a model file, inference only", __FUNCTION__, __LINE__);
+}
+
+const float* nn::hidden_layer::conv2_layer::get_winograd_kernals()
+{
+	if (!winograd_valid)
+	{
+		winograd_kernals.resize(depth * math::winograd_kernal_floats);
+
+		for (size_t i = 0; i < depth; i++)
+			math::winograd_transform_kernal(kernals[i], winograd_kernals.data() + i * math::winograd_kernal_floats);
+
+		winograd_valid = true;
+	}
+
+	return winograd_kernals.data();
 }
 
 nn::hidden_layer::relu_layer::relu_layer(size_t w, size_t h, size_t depth) :w(w), h(h), depth(depth)
@@ -10,6 +10,7 @@
 #include "nn-activate-function.h"
 
 #include <vector>
+#include <string>
 
 namespace nn
 {
@@ -41,20 +42,34 @@ namespace nn
 
 	//== declaration
 
+	// trainable parameters of a layer: values and their accumulated gradients, both size floats
+	// lets generic code (eg. data-parallel training) reduce gradients and copy weights without knowing the layer
+	struct parameter_block
+	{
+		float* values;
+		float* gradients;
+		size_t size;
+	};
+
 	namespace input_layer
 	{
 		struct vector_input
 		{
 		private:
 			vector input;
+			matrix batch_input; // mini-batch: one sample per row
 			size_t input_size;
 
 		public:
 			vector_input(size_t size);
 
 			void push_input(const vector& data);
+			void push_input(const matrix& data); // flattened row by row, without a temporary vector
+			void push_batch(const matrix& data); // data: width = size, height = number of samples
 
 			vector& get_input();
+			matrix& get_batch();
+			size_t get_batch_size(); // number of samples in the current batch
 			size_t get_size();
 		};
 
@@ -98,10 +113,24 @@ namespace nn
 		{
 		private:
 			vector value, gradient;
-			std::vector<vector> weights;
+			vector delta; // scratch: per-neuron weight update coefficients
+			matrix weights; // packed, row-major: row i holds the weights of neuron i (width: num_weights, height: num_neurons)
 			size_t num_weights, num_neurons;
 			float bias;
 
+			// mini-batch state, one sample per row (width: num_neurons)
+			matrix batch_value, batch_gradient, batch_delta;
+			matrix weight_gradient; // accumulated weight updates, same shape as weights
+			float bias_gradient;
+
+			void check_trainable() const; // throws if the weights are mapped from a model file, that memory is read-only
+			void forward_from(const vector& input, const activate_func* func);
+			void update_weights_from(const vector& input, const activate_func* func, float learning_rate);
+
+			void resize_batch(size_t batch_size);
+			void forward_batch_from(const matrix& input, const activate_func* func);
+			void accumulate_gradients_from(const matrix& input, const activate_func* func);
+
 		public:
 			linear_layer(size_t size, size_t weight_size); // size: number of neurons; weight_size: number of weights of each neuron
 
@@ -115,11 +144,37 @@ namespace nn
 			void update_weights(input_layer::vector_input* prev, const activate_func* func, float learning_rate);
 			void update_weights(linear_layer* prev, const activate_func* func, float learning_rate);
 
+			//== mini-batch variants, one sample per row
+
+			void forward_batch(input_layer::vector_input* prev, const activate_func* func);
+			void forward_batch(linear_layer* prev, const activate_func* func);
+
+			void backward_batch(optimizer::vector_optimizer* optimizer);
+			void backward_batch(linear_layer* last);
+
+			// add this batch's weight updates to the gradient buffer, weights are left untouched
+			void accumulate_gradients_batch(input_layer::vector_input* prev, const activate_func* func);
+			void accumulate_gradients_batch(linear_layer* prev, const activate_func* func);
+			// weights += learning_rate * scale * accumulated gradients, then clear the buffer
+			void apply_gradients(float learning_rate, float scale);
+
+			// accumulate + apply, averaged over the batch: one update per batch
+			void update_weights_batch(input_layer::vector_input* prev, const activate_func* func, float learning_rate);
+			void update_weights_batch(linear_layer* prev, const activate_func* func, float learning_rate);
+
 			vector& get_value();
 			vector& get_gradient();
-			vector& get_weight(size_t index); // weight vector for neuron[index]
+			float* get_weight(size_t index); // weights for neuron[index], num_weights floats
+			matrix& get_weights(); // all weights, one row per neuron
+			float& get_bias();
+			matrix& get_batch_value();
+			matrix& get_batch_gradient();
+			matrix& get_weight_gradient();
+			float& get_bias_gradient();
 			size_t get_size();
 
+			void get_parameters(std::vector<parameter_block>& blocks); // appends weights and bias
+
 			void rand_weights(float min, float max);
 		};
 
@@ -131,6 +186,13 @@ namespace nn
 			size_t stride, padding;
 			std::vector<float> bias;
 
+			// winograd F(2x2,3x3) engine, used automatically for 3x3 kernals with stride 1
+			std::vector<float> winograd_kernals; // transformed kernals, cached
+			bool winograd_valid = false; // cleared whenever kernals may have changed
+
+			const float* get_winograd_kernals(); // transform kernals if the cache is stale
+			void check_trainable() const; // throws if the kernals are mapped from a model file, that memory is read-only
+
 		public:
 			const size_t w, h, depth, kernal_size; // in conv-related layers we choose to expose these parameters as const
 
@@ -143,11 +205,15 @@ namespace nn
 			void backward(conv2_layer* last);
 			void backward(relu_layer* last);
 
-			matrix& get_kernal(size_t idx);
+			matrix& get_kernal(size_t idx); // NOTE: invalidates cached transformed kernals, as the kernal may be modified
+			float& get_bias(size_t idx);
 			matrix& get_map(size_t idx);
 			matrix& get_gradient(size_t idx);
 
 			void rand_weights(float min, float max);
+
+			bool use_winograd() const; // kernal_size == 3 && stride == 1
+			void invalidate_kernals(); // call after changing kernal data through a kept reference or pointer
 		};
 
 		// max-pool with down-sampling factor of 2
@@ -233,18 +299,27 @@ namespace nn
 		{
 		protected:
 			vector output, gradient, target;
+			matrix batch_output, batch_gradient, batch_target; // mini-batch, one sample per row
 			size_t optimizer_size = 0;
 			float loss;
 
+			void check_batch(hidden_layer::linear_layer* layer); // check sizes and resize batch buffers
+
 		public:
 			vector& get_gradient();
 			vector& get_output();
+			matrix& get_batch_gradient();
+			matrix& get_batch_output();
 			size_t get_size();
-			float get_loss();
+			float get_loss(); // for batches: average loss per sample
 			void push_target(const vector& target);
+			void push_target_batch(const matrix& targets); // targets: width = size, one sample per row
 
 			virtual void forward_and_grad(hidden_layer::linear_layer* layer) = 0;
 			virtual void forward(hidden_layer::linear_layer* layer) = 0;
+
+			virtual void forward_and_grad_batch(hidden_layer::linear_layer* layer) = 0;
+			virtual void forward_batch(hidden_layer::linear_layer* layer) = 0;
 		};
 
 		struct mse_optimizer :vector_optimizer
@@ -254,6 +329,9 @@ namespace nn
 
 			void forward_and_grad(hidden_layer::linear_layer* layer);
 			void forward(hidden_layer::linear_layer* layer);
+
+			void forward_and_grad_batch(hidden_layer::linear_layer* layer);
+			void forward_batch(hidden_layer::linear_layer* layer);
 		};
 
 		struct softmax_optimizer :vector_optimizer
@@ -263,6 +341,9 @@ namespace nn
 
 			void forward_and_grad(hidden_layer::linear_layer* layer);
 			void forward(hidden_layer::linear_layer* layer);
+
+			void forward_and_grad_batch(hidden_layer::linear_layer* layer);
+			void forward_batch(hidden_layer::linear_layer* layer);
 		};
 	}
 
@@ -283,6 +364,72 @@ namespace nn
 		virtual float get_loss() = 0;
 
 		virtual void init_weights(float min, float max) = 0;
+
+		//== mini-batch interface, optional. inputs and targets hold one (flattened) sample per row
+
+		virtual void feed_batch(const matrix& /*inputs*/)
+		{
+			throw logic_exception("batch mode not implemented", __FUNCTION__, __LINE__);
+		}
+
+		virtual matrix& get_batch_output()
+		{
+			throw logic_exception("batch mode not implemented", __FUNCTION__, __LINE__);
+		}
+
+		virtual void forward_and_grad_batch(const matrix& /*targets*/)
+		{
+			throw logic_exception("batch mode not implemented", __FUNCTION__, __LINE__);
+		}
+
+		virtual void backward_batch()
+		{
+			throw logic_exception("batch mode not implemented", __FUNCTION__, __LINE__);
+		}
+
+		virtual void forward_batch()
+		{
+			throw logic_exception("batch mode not implemented", __FUNCTION__, __LINE__);
+		}
+
+		virtual void update_weights_batch() // one update for the whole batch
+		{
+			throw logic_exception("batch mode not implemented", __FUNCTION__, __LINE__);
+		}
+
+		//== split weight update, optional. needed for data-parallel training (nn-parallel.h)
+
+		virtual void accumulate_gradients_batch() // add this batch's updates to the gradient buffers, weights untouched
+		{
+			throw logic_exception("split update not implemented", __FUNCTION__, __LINE__);
+		}
+
+		virtual void apply_gradients(float /*scale*/) // weights += learning_rate * scale * gradients, clears the buffers
+		{
+			throw logic_exception("split update not implemented", __FUNCTION__, __LINE__);
+		}
+
+		virtual void get_parameters(std::vector<parameter_block>& /*blocks*/) // all trainable parameters, in a fixed order
+		{
+			throw logic_exception("split update not implemented", __FUNCTION__, __LINE__);
+		}
+
+		//== model files, optional (nn-model.h)
+
+		virtual bool save_model(std::string /*path*/) // return true if success
+		{
+			throw logic_exception("model files not implemented", __FUNCTION__, __LINE__);
+		}
+
+		virtual void load_model(std::string /*path*/) // copy weights from a model file
+		{
+			throw logic_exception("model files not implemented", __FUNCTION__, __LINE__);
+		}
+
+		virtual void map_model(std::string /*path*/) // use weights in place from a memory-mapped model file, inference only (updates throw)
+		{
+			throw logic_exception("model files not implemented", __FUNCTION__, __LINE__);
+		}
 	};
 }
 
@@ -0,0 +1,325 @@
+#include "nn-loader.h"
+#include "nn-exception.h"
+
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <memory>
+
+//== sampler helper functions, local
+
+namespace sampler_helper
+{
+	// splitmix64 finalizer, decorrelates consecutive epochs
+	unsigned long long mix(unsigned long long x)
+	{
+		x += 0x9E3779B97F4A7C15ull;
+		x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+		x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+		return x ^ (x >> 31);
+	}
+
+	nn::sampler::mode loader_mode(const nn::batch_loader::options& opts)
+	{
+		if (!opts.shuffle)
+			return nn::sampler::mode::sequential;
+		return opts.block_shuffle ? nn::sampler::mode::block_shuffle : nn::sampler::mode::shuffle;
+	}
+
+	// augmentation seed of batch k, kept apart from the shuffle stream of the same epoch
+	unsigned long long batch_seed(const nn::sampler::state& s, size_t k)
+	{
+		return mix(mix(s.seed ^ mix(s.epoch)) ^ mix(~static_cast<unsigned long long>(k)));
+	}
+}
+
+nn::sampler::sampler(size_t size, mode sample_mode, unsigned long long seed, size_t block_size) :sample_mode(sample_mode), block_size(block_size), seed(seed)
+{
+	if (block_size == 0)
+		throw logic_exception("block size should be positive", __FUNCTION__, __LINE__);
+
+	if (this->seed == 0)
+	{
+		std::random_device rd;
+		this->seed = (static_cast<unsigned long long>(rd()) << 32) | rd();
+	}
+
+	order.resize(size);
+	std::iota(order.begin(), order.end(), size_t(0));
+}
+
+const std::vector<size_t>& nn::sampler::next_epoch()
+{
+	std::iota(order.begin(), order.end(), size_t(0));
+	std::mt19937_64 random(sampler_helper::mix(seed ^ sampler_helper::mix(epoch_count)));
+
+	switch (sample_mode)
+	{
+	case mode::shuffle:
+		std::shuffle(order.begin(), order.end(), random);
+		break;
+
+	case mode::block_shuffle:
+	{
+		const size_t num_blocks = (order.size() + block_size - 1) / block_size;
+
+		std::vector<size_t> blocks(num_blocks);
+		std::iota(blocks.begin(), blocks.end(), size_t(0));
+		std::shuffle(blocks.begin(), blocks.end(), random);
+
+		size_t pos = 0;
+		for (size_t block : blocks)
+		{
+			const size_t first = block * block_size, last = std::min(first + block_size, order.size());
+
+			for (size_t i = first; i < last; i++)
+				order[pos + i - first] = i;
+
+			std::shuffle(order.begin() + pos, order.begin() + pos + (last - first), random);
+			pos += last - first;
+		}
+		break;
+	}
+
+	default:
+		break;
+	}
+
+	epoch_count++;
+	return order;
+}
+
+const std::vector<size_t>& nn::sampler::indices() const
+{
+	return order;
+}
+
+size_t nn::sampler::size() const
+{
+	return order.size();
+}
+
+size_t nn::sampler::epoch() const
+{
+	return epoch_count;
+}
+
+nn::sampler::state nn::sampler::get_state() const
+{
+	return { seed, epoch_count };
+}
+
+void nn::sampler::set_state(const state& s)
+{
+	seed = s.seed;
+
+	if (s.epoch == 0)
+	{
+		epoch_count = 0;
+		std::iota(order.begin(), order.end(), size_t(0));
+		return;
+	}
+
+	epoch_count = s.epoch - 1;
+	next_epoch();
+}
+
+//== batch loader helper functions, local
+
+namespace loader_helper
+{
+	// point view at the first n rows of rows. a view can't be reassigned (that copies), so it's rebuilt in place
+	void view_rows(nn::matrix& view, nn::matrix& rows, size_t n)
+	{
+		std::destroy_at(&view);
+		std::construct_at(&view, rows.width(), n, rows.data(), rows.stride());
+	}
+}
+
+nn::batch_loader::batch_loader(const batch_source& source, options opts)
+	:source(source), opts(opts), order(source.size(), sampler_helper::loader_mode(opts), opts.seed, std::max<size_t>(opts.block_size, 1))
+{
+	if (opts.batch_size == 0 || opts.prefetch == 0 || opts.num_threads == 0)
+		throw logic_exception("batch size, prefetch depth and thread count should be positive", __FUNCTION__, __LINE__);
+	if (opts.augment != nullptr && opts.augment->sample_size() != source.input_size())
+		throw logic_exception("augmenter sample size doesn't match the source", __FUNCTION__, __LINE__);
+
+	num_batches = opts.drop_last
+		? source.size() / opts.batch_size
+		: (source.size() + opts.batch_size - 1) / opts.batch_size;
+
+	// preallocate every buffer, a smaller last batch is a view over fewer rows of the same buffers
+	slots.resize(opts.prefetch);
+	for (auto& s : slots)
+	{
+		s.inputs = matrix(source.input_size(), opts.batch_size);
+		s.targets = matrix(source.target_size(), opts.batch_size);
+		if (s.inputs.stride() != source.input_size())
+			s.staging_inputs = vector(source.input_size() * opts.batch_size);
+		if (s.targets.stride() != source.target_size())
+			s.staging_targets = vector(source.target_size() * opts.batch_size);
+		loader_helper::view_rows(s.data.inputs, s.inputs, opts.batch_size);
+		loader_helper::view_rows(s.data.targets, s.targets, opts.batch_size);
+		s.data.size = 0;
+		s.data.index = 0;
+	}
+
+	start_epoch();
+
+	for (size_t i = 0; i < opts.num_threads; i++)
+		threads.emplace_back(&batch_loader::loader_loop, this);
+}
+
+nn::batch_loader::batch_loader(const batch_source& source, size_t batch_size) :batch_loader(source, options{ batch_size })
+{
+}
+
+nn::batch_loader::~batch_loader()
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+	}
+	changed.notify_all();
+
+	for (auto& t : threads)
+		t.join();
+}
+
+void nn::batch_loader::loader_loop()
+{
+	std::unique_lock<std::mutex> guard(lock);
+
+	while (true)
+	{
+		// a batch may be loaded once its slot has been handed back by the consumer
+		changed.wait(guard, [this]()
+			{
+				return stopping || (next_fill < num_batches && next_fill < next_take + opts.prefetch - (holding ? 1 : 0));
+			});
+
+		if (stopping)
+			return;
+
+		const size_t k = next_fill++;
+		slot& s = slots[k % opts.prefetch];
+		in_flight++;
+
+		const size_t first = k * opts.batch_size;
+		const size_t n = std::min(opts.batch_size, order.size() - first);
+		const size_t* indices = order.indices().data() + first;
+		const unsigned long long augment_seed = sampler_helper::batch_seed(order.get_state(), k);
+
+		guard.unlock();
+
+		if (s.data.inputs.height() != n)
+		{
+			loader_helper::view_rows(s.data.inputs, s.inputs, n);
+			loader_helper::view_rows(s.data.targets, s.targets, n);
+		}
+
+		// sources write packed samples, straight into the batch unless its rows are padded
+		const bool pack_inputs = s.data.inputs.stride() != s.data.inputs.width();
+		const bool pack_targets = s.data.targets.stride() != s.data.targets.width();
+		float* inputs = pack_inputs ? s.staging_inputs.data() : s.data.inputs.data();
+		float* targets = pack_targets ? s.staging_targets.data() : s.data.targets.data();
+
+		source.fill_batch(indices, n, inputs, targets);
+		if (opts.augment != nullptr)
+			opts.augment->apply_batch(inputs, n, augment_seed);
+
+		if (pack_inputs)
+			s.data.inputs.copy_from(inputs);
+		if (pack_targets)
+			s.data.targets.copy_from(targets);
+		s.data.size = n;
+		s.data.index = k;
+
+		guard.lock();
+
+		s.ready = true;
+		in_flight--;
+		changed.notify_all();
+	}
+}
+
+void nn::batch_loader::release_held()
+{
+	if (!holding)
+		return;
+
+	slots[(next_take - 1) % opts.prefetch].ready = false;
+	holding = false;
+	changed.notify_all();
+}
+
+const nn::batch_loader::batch* nn::batch_loader::next()
+{
+	std::unique_lock<std::mutex> guard(lock);
+
+	release_held();
+
+	if (next_take >= num_batches)
+		return nullptr;
+
+	slot& s = slots[next_take % opts.prefetch];
+	changed.wait(guard, [&s]() { return s.ready; });
+
+	next_take++;
+	holding = true;
+
+	return &s.data;
+}
+
+void nn::batch_loader::start_epoch()
+{
+	std::unique_lock<std::mutex> guard(lock);
+
+	// let loads of the previous epoch finish, they use the old order
+	changed.wait(guard, [this]() { return in_flight == 0; });
+
+	order.next_epoch();
+
+	for (auto& s : slots)
+		s.ready = false;
+
+	next_fill = 0;
+	next_take = 0;
+	holding = false;
+
+	changed.notify_all();
+}
+
+size_t nn::batch_loader::batches_per_epoch() const
+{
+	return num_batches;
+}
+
+nn::sampler::state nn::batch_loader::get_sampler_state() const
+{
+	sampler::state s = order.get_state();
+	s.batch = next_take; // only the consumer moves next_take
+	return s;
+}
+
+void nn::batch_loader::set_sampler_state(const sampler::state& s)
+{
+	if (s.batch > num_batches)
+		throw logic_exception("sampler state batch out of range", __FUNCTION__, __LINE__);
+
+	std::unique_lock<std::mutex> guard(lock);
+
+	changed.wait(guard, [this]() { return in_flight == 0; });
+
+	order.set_state(s);
+
+	for (auto& slot : slots)
+		slot.ready = false;
+
+	// batches before s.batch were trained before the checkpoint, loading starts after them
+	next_fill = s.batch;
+	next_take = s.batch;
+	holding = false;
+
+	changed.notify_all();
+}
@@ -0,0 +1,135 @@
+// FILENAME: nn-loader.h
+// Background batch loading: upcoming batches are gathered on loader threads into a ring of preallocated buffers
+// so the training loop only waits for data when the loader can't keep up
+
+#ifndef NN_LOADER_H
+#define NN_LOADER_H
+
+#include "nn-math.h"
+#include "nn-dataset.h"
+#include "nn-augment.h"
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace nn
+{
+	// sample order for each epoch. the permutation of an epoch depends only on (seed, epoch), so runs are reproducible
+	// and a run can be resumed from get_state()
+	class sampler
+	{
+	public:
+		enum class mode
+		{
+			sequential, // file order
+			shuffle, // full random permutation
+			block_shuffle // random order of contiguous blocks, shuffled inside each block: mostly sequential memory access (mmap)
+		};
+
+		struct state
+		{
+			unsigned long long seed;
+			size_t epoch; // epochs generated so far
+			size_t batch = 0; // batches of the epoch already handed out, set by batch_loader. the sampler ignores it
+		};
+
+	private:
+		std::vector<size_t> order;
+		mode sample_mode;
+		size_t block_size;
+		unsigned long long seed;
+		size_t epoch_count = 0;
+
+	public:
+		sampler(size_t size, mode sample_mode = mode::shuffle, unsigned long long seed = 0, size_t block_size = 1024); // seed 0: random
+
+		const std::vector<size_t>& next_epoch(); // generate the order of the next epoch
+		const std::vector<size_t>& indices() const; // order of the current epoch
+
+		size_t size() const;
+		size_t epoch() const; // epochs generated so far
+
+		state get_state() const;
+		void set_state(const state& s); // regenerates the order of epoch s.epoch, next_epoch() continues after it
+	};
+
+	class batch_loader
+	{
+	public:
+		struct batch
+		{
+			matrix inputs, targets; // one sample per row, height == size
+			size_t size; // number of samples
+			size_t index; // batch number in the current epoch
+		};
+
+		struct options
+		{
+			size_t batch_size = 32;
+			size_t prefetch = 4; // number of batch buffers, how far loading may run ahead
+			size_t num_threads = 1; // loader threads
+			bool shuffle = true; // new random order every epoch
+			bool block_shuffle = false; // shuffle in contiguous blocks of block_size samples, see sampler
+			size_t block_size = 1024;
+			bool drop_last = true; // skip the last batch if it's not full
+			unsigned long long seed = 0; // shuffle seed, 0: random
+			// applied to every input on the loader threads, must outlive the loader. nullptr: none
+			// random choices depend only on (seed, epoch, batch index), so augmented epochs are reproducible too
+			const augmenter* augment = nullptr;
+		};
+
+	private:
+		struct slot
+		{
+			batch data; // inputs and targets are views over the first data.size rows of the buffers below
+			matrix inputs, targets; // batch_size rows each, allocated once
+			vector staging_inputs, staging_targets; // packed rows for fill_batch, used only if the batch rows are padded
+			bool ready = false; // filled, not yet handed out
+		};
+
+		const batch_source& source;
+		const options opts;
+
+		sampler order; // sample order of the current epoch
+		std::vector<slot> slots; // batch k lives in slots[k % prefetch]
+
+		size_t num_batches = 0; // per epoch
+		size_t next_fill = 0; // next batch to be claimed by a loader thread
+		size_t next_take = 0; // next batch handed to the consumer
+		size_t in_flight = 0; // batches being filled right now
+		bool holding = false; // consumer still holds batch next_take - 1
+		bool stopping = false;
+
+		std::mutex lock;
+		std::condition_variable changed;
+		std::vector<std::thread> threads;
+
+		void loader_loop();
+		void release_held(); // lock must be held
+
+	public:
+		batch_loader(const batch_source& source, options opts);
+		batch_loader(const batch_source& source, size_t batch_size);
+		~batch_loader();
+
+		batch_loader(const batch_loader&) = delete;
+		batch_loader& operator =(const batch_loader&) = delete;
+
+		// next batch of the epoch, blocks until it's loaded. nullptr at the end of the epoch
+		// the batch stays valid until the next call to next() or start_epoch()
+		const batch* next();
+
+		// start a new epoch (reshuffled). the constructor already starts the first one
+		void start_epoch();
+
+		size_t batches_per_epoch() const;
+
+		// epoch, seed and the number of batches next() returned in this epoch, for checkpoints. call from the consumer thread
+		sampler::state get_sampler_state() const;
+		void set_sampler_state(const sampler::state& s); // the next next() returns batch s.batch of the epoch recorded in s
+	};
+}
+
+#endif
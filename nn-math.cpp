@@ -1,28 +1,738 @@
 #include "nn-math.h"
+#include "nn-simd.h"
 
 #include <random>
+#include <new>
+#include <algorithm>
+#include <complex>
+#include <numbers>
+#include <array>
+#include <atomic>
 
 float nn::math::dot(float* left, float* right, size_t num)
 {
-	float result = 0.0f;
-	for (size_t i = 0; i < num; i++)
-		result += left[i] * right[i];
-	return result;
+	return simd::kernels().dot(left, right, num);
 }
 
 void nn::math::add(float* array, float addition, size_t num)
 {
-	for (size_t i = 0; i < num; i++)
+	simd::kernels().add_scalar(array, addition, num);
+}
+
+void nn::math::add(float* left, float* right, size_t num)
+{
+	simd::kernels().add(left, right, num);
+}
+
+void nn::math::axpy(float* y, float alpha, const float* x, size_t num)
+{
+	simd::kernels().axpy(y, alpha, x, num);
+}
+
+//== gemm helper functions, local
+
+namespace gemm_helper
+{
+	constexpr size_t mr = nn::simd::gemm_mr, nr = nn::simd::gemm_nr;
+
+	// block sizes: a kc*nr panel of B stays in L1, an mc*kc block of A in L2, a kc*nc block of B in L3
+	constexpr size_t kc_block = 256;
+	constexpr size_t mc_block = 72; // multiple of mr
+	constexpr size_t nc_block = 4080; // multiple of nr
+
+	// per-thread packing buffers, grown on demand and reused between calls
+	thread_local std::vector<float> packed_a, packed_b;
+
+	// pack an mc*kc block of op(A) into mr-row panels, zero-padding the last panel
+	void pack_a(bool trans, const float* a, size_t lda, size_t i0, size_t p0, size_t mc, size_t kc, float* dst)
+	{
+		for (size_t ir = 0; ir < mc; ir += mr)
+		{
+			size_t rows = std::min(mr, mc - ir);
+
+			for (size_t p = 0; p < kc; p++)
+			{
+				for (size_t r = 0; r < rows; r++)
+				{
+					size_t i = i0 + ir + r, col = p0 + p;
+					dst[r] = trans ? a[col * lda + i] : a[i * lda + col];
+				}
+				for (size_t r = rows; r < mr; r++)
+					dst[r] = 0.0f;
+
+				dst += mr;
+			}
+		}
+	}
+
+	// pack a kc*nc block of op(B) into nr-column panels, zero-padding the last panel
+	void pack_b(bool trans, const float* b, size_t ldb, size_t p0, size_t j0, size_t kc, size_t nc, float* dst)
+	{
+		for (size_t jr = 0; jr < nc; jr += nr)
+		{
+			size_t cols = std::min(nr, nc - jr);
+
+			for (size_t p = 0; p < kc; p++)
+			{
+				size_t row = p0 + p;
+
+				if (!trans && cols == nr)
+				{
+					memcpy(dst, b + row * ldb + j0 + jr, sizeof(float) * nr);
+				}
+				else
+				{
+					for (size_t c = 0; c < cols; c++)
+					{
+						size_t j = j0 + jr + c;
+						dst[c] = trans ? b[j * ldb + row] : b[row * ldb + j];
+					}
+					for (size_t c = cols; c < nr; c++)
+						dst[c] = 0.0f;
+				}
+
+				dst += nr;
+			}
+		}
+	}
+
+	// C *= beta, without reading C when beta is 0 (C may be uninitialized)
+	void scale_c(size_t m, size_t n, float beta, float* c, size_t ldc)
 	{
-		array[i] += addition;
+		if (beta == 1.0f)
+			return;
+
+		for (size_t i = 0; i < m; i++)
+		{
+			float* row = c + i * ldc;
+
+			if (beta == 0.0f)
+				std::fill(row, row + n, 0.0f);
+			else
+				for (size_t j = 0; j < n; j++)
+					row[j] *= beta;
+		}
 	}
 }
 
-void nn::math::add(float* left, float* right, size_t num)
+//== convolution helper functions, local
+
+namespace conv_helper
+{
+	constexpr size_t max_column_floats = 1 << 20; // limit im2col buffer to 4MB, larger outputs are processed in row blocks
+
+	// per-thread buffers, grown on demand and reused between calls
+	thread_local std::vector<float> columns, packed_kernals, output;
+
+	float* get_columns(size_t num)
+	{
+		if (columns.size() < num)
+			columns.resize(num);
+		return columns.data();
+	}
+
+	// kernal taps back to back: the matrix itself if its rows are dense, else a copy in packed_kernals
+	const float* dense_kernal(const nn::matrix& kernal)
+	{
+		if (kernal.stride() == kernal.width())
+			return kernal.data();
+
+		packed_kernals.resize(kernal.width() * kernal.height());
+		kernal.copy_to(packed_kernals.data());
+		return packed_kernals.data();
+	}
+
+	// where to compute output rows [y0, y0 + rows) as one dense run of pixels: straight into dst if its rows are dense
+	float* output_rows(nn::matrix& dst, size_t y0, size_t rows)
+	{
+		if (dst.stride() == dst.width())
+			return dst.row(y0);
+
+		output.resize(rows * dst.width());
+		return output.data();
+	}
+
+	// copy rows computed by output_rows into a padded dst
+	void store_rows(nn::matrix& dst, size_t y0, size_t rows, const float* pixels)
+	{
+		if (pixels == dst.row(y0))
+			return;
+
+		for (size_t y = 0; y < rows; y++)
+			memcpy(dst.row(y0 + y), pixels + y * dst.width(), sizeof(float) * dst.width());
+	}
+
+	// number of output rows lowered per im2col pass
+	size_t rows_per_block(size_t taps, size_t out_w)
+	{
+		size_t rows = max_column_floats / std::max<size_t>(taps * out_w, 1);
+		return std::max<size_t>(rows, 1);
+	}
+
+	void check_conv(const nn::matrix& dst, size_t src_w, size_t src_h, size_t kw, size_t kh, size_t stride, size_t padding)
+	{
+		if (kw > src_w || kh > src_h)
+			throw nn::numeric_exception("(conv)kernal bigger than source", __FUNCTION__, __LINE__);
+		if (stride == 0)
+			throw nn::numeric_exception("(conv)stride should be larger than 0", __FUNCTION__, __LINE__);
+
+		// calculate height and width
+		size_t output_w = (src_w - kw + padding * 2 + 1) / stride;
+		size_t output_h = (src_h - kh + padding * 2 + 1) / stride;
+
+		if (dst.width() != output_w || dst.height() != output_h)
+			throw nn::numeric_exception("mismatch DST size", __FUNCTION__, __LINE__);
+	}
+
+	// lower output rows [y0, y0 + rows) to columns: row (ky * kw + kx) holds the source value under tap (kx, ky) for every output pixel
+	// source values in the padding area are 0
+	void im2col(const float* src, size_t src_w, size_t src_h, size_t src_stride, size_t kw, size_t kh, size_t stride, size_t padding, size_t out_w, size_t y0, size_t rows, float* dst)
+	{
+		const ptrdiff_t sw = src_w, sh = src_h, pad = padding, st = stride;
+
+		for (size_t ky = 0; ky < kh; ky++) for (size_t kx = 0; kx < kw; kx++)
+		{
+			for (size_t y = y0; y < y0 + rows; y++)
+			{
+				ptrdiff_t sy = static_cast<ptrdiff_t>(y) * st + ky - pad;
+
+				if (sy < 0 || sy >= sh) // whole row in padding area
+				{
+					std::fill(dst, dst + out_w, 0.0f);
+					dst += out_w;
+					continue;
+				}
+
+				const float* src_row = src + sy * src_stride;
+
+				// valid x range: 0 <= x * stride + kx - padding < src_w
+				ptrdiff_t x_begin = 0, x_end = out_w;
+				ptrdiff_t first = pad - static_cast<ptrdiff_t>(kx);
+				if (first > 0)
+					x_begin = std::min<ptrdiff_t>((first + st - 1) / st, out_w);
+				ptrdiff_t last = sw - 1 + pad - static_cast<ptrdiff_t>(kx); // x * stride <= last
+				x_end = last < 0 ? 0 : std::min<ptrdiff_t>(last / st + 1, out_w);
+				x_end = std::max(x_end, x_begin);
+
+				std::fill(dst, dst + x_begin, 0.0f);
+
+				if (st == 1)
+				{
+					memcpy(dst + x_begin, src_row + x_begin + kx - pad, sizeof(float) * (x_end - x_begin));
+				}
+				else
+				{
+					for (ptrdiff_t x = x_begin; x < x_end; x++)
+						dst[x] = src_row[x * st + kx - pad];
+				}
+
+				std::fill(dst + x_end, dst + out_w, 0.0f);
+				dst += out_w;
+			}
+		}
+	}
+}
+
+//== winograd F(2x2,3x3) helper functions, local
+
+namespace winograd_helper
+{
+	constexpr size_t max_tiles = 2048; // tiles transformed per pass, bounds the transformed-domain buffers to 128KB each
+
+	// per-thread buffers, grown on demand and reused between calls
+	thread_local std::vector<float> padded, transformed_input, result;
+
+	// V = B^T * d * B for one 4x4 input tile d (row stride ld); element e of V is stored at v[e * stride]
+	inline void transform_input(const float* d, size_t ld, float* v, size_t stride)
+	{
+		float t[16];
+
+		for (size_t c = 0; c < 4; c++)
+		{
+			float d0 = d[c], d1 = d[ld + c], d2 = d[2 * ld + c], d3 = d[3 * ld + c];
+			t[c] = d0 - d2;
+			t[4 + c] = d1 + d2;
+			t[8 + c] = d2 - d1;
+			t[12 + c] = d1 - d3;
+		}
+
+		for (size_t r = 0; r < 4; r++)
+		{
+			const float* row = t + r * 4;
+			v[(r * 4) * stride] = row[0] - row[2];
+			v[(r * 4 + 1) * stride] = row[1] + row[2];
+			v[(r * 4 + 2) * stride] = row[2] - row[1];
+			v[(r * 4 + 3) * stride] = row[1] - row[3];
+		}
+	}
+
+	void conv(nn::matrix* dst, size_t count, const nn::matrix& src, const float* transformed, size_t padding)
+	{
+		if (src.width() < 3 || src.height() < 3)
+			throw nn::numeric_exception("(conv)kernal bigger than source", __FUNCTION__, __LINE__);
+
+		const size_t out_w = src.width() + padding * 2 - 2, out_h = src.height() + padding * 2 - 2;
+
+		for (size_t i = 0; i < count; i++)
+			if (dst[i].width() != out_w || dst[i].height() != out_h)
+				throw nn::numeric_exception("mismatch DST size", __FUNCTION__, __LINE__);
+
+		// zero-padded copy of the source, rounded up to whole 2x2 output tiles
+		const size_t tiles_x = (out_w + 1) / 2, tiles_y = (out_h + 1) / 2;
+		const size_t pw = tiles_x * 2 + 2, ph = tiles_y * 2 + 2;
+
+		padded.assign(pw * ph, 0.0f);
+		for (size_t y = 0; y < src.height(); y++)
+			memcpy(padded.data() + (y + padding) * pw + padding, src.row(y), sizeof(float) * src.width());
+
+		auto& kernels = nn::simd::kernels();
+
+		// process whole rows of tiles, as many as fit in max_tiles
+		const size_t rows_per_pass = std::max<size_t>(max_tiles / tiles_x, 1);
+
+		for (size_t ty0 = 0; ty0 < tiles_y; ty0 += rows_per_pass)
+		{
+			const size_t rows = std::min(rows_per_pass, tiles_y - ty0);
+			const size_t num = rows * tiles_x;
+
+			// input transform, once for all kernals. layout: 16 rows of num tiles
+			transformed_input.resize(16 * num);
+			result.resize(4 * num);
+
+			for (size_t r = 0; r < rows; r++) for (size_t tx = 0; tx < tiles_x; tx++)
+				transform_input(padded.data() + (ty0 + r) * 2 * pw + tx * 2, pw, transformed_input.data() + r * tiles_x + tx, num);
+
+			for (size_t i = 0; i < count; i++)
+			{
+				// element-wise product with the transformed kernal and output transform, vectorized across tiles
+				kernels.winograd_output(transformed_input.data(), transformed + i * nn::math::winograd_kernal_floats, result.data(), num);
+
+				// scatter 2x2 tiles into the output, skipping the parts beyond the right/bottom border
+				for (size_t r = 0; r < rows; r++)
+				{
+					const size_t y = (ty0 + r) * 2;
+					const float* y0 = result.data() + r * tiles_x;
+
+					for (size_t dy = 0; dy < 2 && y + dy < out_h; dy++)
+					{
+						float* out_row = dst[i].row(y + dy);
+						const float* left = y0 + (dy * 2) * num;
+						const float* right = y0 + (dy * 2 + 1) * num;
+
+						for (size_t tx = 0; tx < tiles_x; tx++)
+						{
+							out_row[tx * 2] = left[tx];
+							if (tx * 2 + 1 < out_w)
+								out_row[tx * 2 + 1] = right[tx];
+						}
+					}
+				}
+			}
+		}
+	}
+}
+
+//== fft convolution helper functions, local
+
+namespace fft_helper
+{
+	using complex = std::complex<float>;
+
+	constexpr size_t min_kernal_taps = 7 * 7; // smaller kernals always use im2col
+	constexpr size_t cache_entries = 8;
+
+	// plain product, std::complex operator* has inf/nan recovery paths that keep it from being inlined
+	inline complex mul(complex a, complex b)
+	{
+		return complex(a.real() * b.real() - a.imag() * b.imag(), a.real() * b.imag() + a.imag() * b.real());
+	}
+
+	std::vector<complex>& scratch()
+	{
+		thread_local std::vector<complex> buffer;
+		return buffer;
+	}
+
+	size_t next_pow2(size_t n)
+	{
+		size_t p = 4; // real fft works on halves, keep at least 2 complex points
+		while (p < n)
+			p <<= 1;
+		return p;
+	}
+
+	size_t log2(size_t n)
+	{
+		size_t l = 0;
+		while ((size_t(1) << l) < n)
+			l++;
+		return l;
+	}
+
+	// w[k] = exp(-2*pi*i*k/n), k < n/2; cached per size
+	const std::vector<complex>& twiddles(size_t n)
+	{
+		thread_local std::vector<std::vector<complex>> tables(64);
+		auto& table = tables[log2(n)];
+
+		if (table.size() != n / 2)
+		{
+			table.resize(n / 2);
+			for (size_t k = 0; k < n / 2; k++)
+			{
+				double angle = -2.0 * std::numbers::pi * static_cast<double>(k) / static_cast<double>(n);
+				table[k] = complex(static_cast<float>(cos(angle)), static_cast<float>(sin(angle)));
+			}
+		}
+
+		return table;
+	}
+
+	// in-place iterative radix-2 fft over `rows` elements spaced by whole rows of `cols` complex numbers
+	// every column is transformed at once, so the butterflies stream over contiguous rows. unscaled
+	void fft_columns(complex* data, size_t rows, size_t cols, bool inverse)
+	{
+		// bit-reversal permutation of rows
+		for (size_t i = 1, j = 0; i < rows; i++)
+		{
+			size_t bit = rows >> 1;
+			for (; j & bit; bit >>= 1)
+				j ^= bit;
+			j ^= bit;
+
+			if (i < j)
+				std::swap_ranges(data + i * cols, data + (i + 1) * cols, data + j * cols);
+		}
+
+		const auto& w = twiddles(rows);
+
+		for (size_t len = 2; len <= rows; len <<= 1)
+		{
+			const size_t half = len / 2, step = rows / len;
+
+			for (size_t start = 0; start < rows; start += len)
+			{
+				for (size_t k = 0; k < half; k++)
+				{
+					complex tw = inverse ? std::conj(w[k * step]) : w[k * step];
+					complex* a = data + (start + k) * cols;
+					complex* b = data + (start + k + half) * cols;
+
+					for (size_t c = 0; c < cols; c++)
+					{
+						complex t = mul(tw, b[c]);
+						b[c] = a[c] - t;
+						a[c] += t;
+					}
+				}
+			}
+		}
+	}
+
+	// n reals -> n/2+1 complex (the rest of the spectrum is conjugate-symmetric), through one n/2 point complex fft
+	void rfft(const float* in, complex* out, size_t n)
+	{
+		const size_t h = n / 2;
+
+		for (size_t k = 0; k < h; k++)
+			out[k] = complex(in[2 * k], in[2 * k + 1]);
+
+		fft_columns(out, h, 1, false);
+
+		const auto& w = twiddles(n);
+		const complex z0 = out[0];
+
+		out[h] = complex(z0.real() - z0.imag(), 0.0f);
+		out[0] = complex(z0.real() + z0.imag(), 0.0f);
+
+		// split even/odd spectra, pairing k with h-k
+		for (size_t k = 1; k <= h / 2; k++)
+		{
+			complex zk = out[k], zc = std::conj(out[h - k]);
+
+			complex even = 0.5f * (zk + zc), odd = complex(0.0f, -0.5f) * (zk - zc);
+			complex even_c = std::conj(even), odd_c = std::conj(odd); // values for h-k
+
+			out[k] = even + mul(w[k], odd);
+			if (k != h - k)
+				out[h - k] = even_c + mul(w[h - k], odd_c);
+		}
+	}
+
+	// inverse of rfft, n/2+1 complex -> n reals, scaled (irfft(rfft(x)) == x). in is used as scratch
+	void irfft(complex* in, float* out, size_t n)
+	{
+		const size_t h = n / 2;
+		const auto& w = twiddles(n);
+
+		std::vector<complex>& z = scratch();
+		z.resize(h);
+
+		for (size_t k = 0; k < h; k++)
+		{
+			complex xk = in[k], xc = std::conj(in[h - k]);
+			complex even = 0.5f * (xk + xc), odd = mul(0.5f * (xk - xc), std::conj(w[k]));
+			z[k] = even + complex(0.0f, 1.0f) * odd;
+		}
+
+		fft_columns(z.data(), h, 1, true);
+
+		const float scale = 1.0f / h;
+		for (size_t k = 0; k < h; k++)
+		{
+			out[2 * k] = z[k].real() * scale;
+			out[2 * k + 1] = z[k].imag() * scale;
+		}
+	}
+
+	// 2d real fft: nx*ny reals -> ny rows of nx/2+1 complex
+	void rfft2(const float* in, size_t nx, size_t ny, complex* out)
+	{
+		const size_t cols = nx / 2 + 1;
+
+		for (size_t y = 0; y < ny; y++)
+			rfft(in + y * nx, out + y * cols, nx);
+
+		fft_columns(out, ny, cols, false);
+	}
+
+	// inverse of rfft2, scaled. in is destroyed
+	void irfft2(complex* in, size_t nx, size_t ny, float* out)
+	{
+		const size_t cols = nx / 2 + 1;
+
+		fft_columns(in, ny, cols, true);
+
+		const float scale = 1.0f / ny;
+		for (size_t i = 0; i < ny * cols; i++)
+			in[i] *= scale;
+
+		for (size_t y = 0; y < ny; y++)
+			irfft(in + y * cols, out + y * nx, nx);
+	}
+
+	// size of the transform: every source position read by the output must fit without circular wrap-around
+	void transform_size(size_t src_w, size_t src_h, size_t kw, size_t kh, size_t out_w, size_t out_h, size_t stride, size_t padding, size_t& nx, size_t& ny)
+	{
+		nx = next_pow2(std::max(src_w + 2 * padding, (out_w - 1) * stride + kw));
+		ny = next_pow2(std::max(src_h + 2 * padding, (out_h - 1) * stride + kh));
+	}
+
+	// rough flop estimates; the im2col path runs a vectorized gemv, the fft is scalar complex arithmetic
+	bool fft_cheaper(size_t src_w, size_t src_h, size_t kw, size_t kh, size_t out_w, size_t out_h, size_t stride, size_t padding)
+	{
+		if (kw * kh < min_kernal_taps || out_w == 0 || out_h == 0)
+			return false;
+
+		size_t nx, ny;
+		transform_size(src_w, src_h, kw, kh, out_w, out_h, stride, padding, nx, ny);
+
+		// forward + inverse transform (~2.5 n log n each for a half-size complex fft) plus the spectrum product
+		const double n = static_cast<double>(nx) * ny;
+		const double fft_cost = 2.0 * 2.5 * n * log2(nx * ny) + 3.0 * n;
+
+		// im2col copies every tap once and then does 2 flops per tap, at 8 lanes or so
+		const double direct_cost = static_cast<double>(out_w) * out_h * kw * kh * (1.0 + 2.0 / 8.0);
+
+		return fft_cost < direct_cost;
+	}
+
+	//== kernal spectrum cache
+
+	struct spectrum_entry
+	{
+		const float* kernal = nullptr;
+		size_t kw = 0, kh = 0, nx = 0, ny = 0;
+		uint64_t hash = 0;
+		std::vector<complex> spectrum; // conjugated: cross-correlation is a product with conj(K)
+	};
+
+	// fnv-1a over the raw bits of every row, so in-place edits of a kernal (training) are noticed
+	uint64_t hash_floats(const nn::matrix& m)
+	{
+		uint64_t hash = 14695981039346656037ull;
+
+		for (size_t y = 0; y < m.height(); y++)
+		{
+			const unsigned char* bytes = reinterpret_cast<const unsigned char*>(m.row(y));
+
+			for (size_t i = 0; i < m.width() * sizeof(float); i++)
+			{
+				hash ^= bytes[i];
+				hash *= 1099511628211ull;
+			}
+		}
+
+		return hash;
+	}
+
+	const std::vector<complex>& kernal_spectrum(const nn::matrix& kernal, size_t nx, size_t ny)
+	{
+		thread_local std::array<spectrum_entry, cache_entries> cache;
+		thread_local size_t next_slot = 0;
+		thread_local std::vector<float> padded;
+
+		const size_t kw = kernal.width(), kh = kernal.height();
+		const uint64_t hash = hash_floats(kernal);
+
+		for (auto& entry : cache)
+			if (entry.kernal == kernal.data() && entry.kw == kw && entry.kh == kh && entry.nx == nx && entry.ny == ny && entry.hash == hash)
+				return entry.spectrum;
+
+		// miss, replace round-robin
+		spectrum_entry& entry = cache[next_slot];
+		next_slot = (next_slot + 1) % cache_entries;
+
+		padded.assign(nx * ny, 0.0f);
+		for (size_t y = 0; y < kh; y++)
+			std::copy(kernal.row(y), kernal.row(y) + kw, padded.data() + y * nx);
+
+		entry.spectrum.resize(ny * (nx / 2 + 1));
+		rfft2(padded.data(), nx, ny, entry.spectrum.data());
+		for (auto& c : entry.spectrum)
+			c = std::conj(c);
+
+		entry.kernal = kernal.data();
+		entry.kw = kw;
+		entry.kh = kh;
+		entry.nx = nx;
+		entry.ny = ny;
+		entry.hash = hash;
+
+		return entry.spectrum;
+	}
+}
+
+//== memory helper functions, local
+
+namespace memory_helper
+{
+	std::atomic<size_t> allocations{ 0 }; // alloc_buffer calls
+}
+
+float* nn::math::alloc_buffer(size_t num)
+{
+	if (num == 0)
+		return nullptr;
+
+	memory_helper::allocations.fetch_add(1, std::memory_order_relaxed);
+
+	try
+	{
+		return static_cast<float*>(::operator new[](sizeof(float) * num, std::align_val_t(buffer_alignment)));
+	}
+	catch (std::bad_alloc&)
+	{
+		throw memory_exception(sizeof(float) * num, __FUNCTION__, __LINE__);
+	}
+}
+
+void nn::math::free_buffer(float* ptr)
+{
+	if (ptr)
+		::operator delete[](ptr, std::align_val_t(buffer_alignment));
+}
+
+size_t nn::math::buffer_allocations()
+{
+	return memory_helper::allocations.load(std::memory_order_relaxed);
+}
+
+void nn::math::gemm(bool trans_a, bool trans_b, size_t m, size_t n, size_t k, float alpha, const float* a, size_t lda, const float* b, size_t ldb, float beta, float* c, size_t ldc)
+{
+	using namespace gemm_helper;
+
+	scale_c(m, n, beta, c, ldc);
+
+	if (m == 0 || n == 0 || k == 0 || alpha == 0.0f)
+		return;
+
+	auto& kernels = simd::kernels();
+
+	packed_a.resize(mc_block * kc_block);
+	packed_b.resize(kc_block * nc_block);
+
+	float edge_tile[mr * nr];
+
+	for (size_t jc = 0; jc < n; jc += nc_block)
+	{
+		size_t nc = std::min(nc_block, n - jc);
+
+		for (size_t pc = 0; pc < k; pc += kc_block)
+		{
+			size_t kc = std::min(kc_block, k - pc);
+			pack_b(trans_b, b, ldb, pc, jc, kc, nc, packed_b.data());
+
+			for (size_t ic = 0; ic < m; ic += mc_block)
+			{
+				size_t mc = std::min(mc_block, m - ic);
+				pack_a(trans_a, a, lda, ic, pc, mc, kc, packed_a.data());
+
+				for (size_t jr = 0; jr < nc; jr += nr)
+				{
+					const float* b_panel = packed_b.data() + jr * kc;
+					size_t cols = std::min(nr, nc - jr);
+
+					for (size_t ir = 0; ir < mc; ir += mr)
+					{
+						const float* a_panel = packed_a.data() + ir * kc;
+						size_t rows = std::min(mr, mc - ir);
+						float* c_tile = c + (ic + ir) * ldc + jc + jr;
+
+						if (rows == mr && cols == nr)
+						{
+							kernels.gemm_micro(kc, a_panel, b_panel, c_tile, ldc, alpha);
+						}
+						else // partial tile on the border, compute into a local tile then copy the valid part
+						{
+							std::fill(edge_tile, edge_tile + mr * nr, 0.0f);
+							kernels.gemm_micro(kc, a_panel, b_panel, edge_tile, nr, alpha);
+
+							for (size_t i = 0; i < rows; i++)
+								for (size_t j = 0; j < cols; j++)
+									c_tile[i * ldc + j] += edge_tile[i * nr + j];
+						}
+					}
+				}
+			}
+		}
+	}
+}
+
+void nn::math::gemv(bool trans_a, size_t m, size_t n, float alpha, const float* a, size_t lda, const float* x, float beta, float* y)
+{
+	auto& kernels = simd::kernels();
+
+	if (!trans_a)
+	{
+		// y[i] = alpha * dot(A[i], x) + beta * y[i], rows of A are contiguous
+		for (size_t i = 0; i < m; i++)
+		{
+			float result = alpha * kernels.dot(a + i * lda, x, n);
+			y[i] = beta == 0.0f ? result : result + beta * y[i];
+		}
+	}
+	else
+	{
+		// y = sum of rows of A weighted by x, streams A row by row instead of striding down columns
+		gemm_helper::scale_c(1, n, beta, y, n);
+
+		for (size_t i = 0; i < m; i++)
+		{
+			if (x[i] != 0.0f)
+				kernels.axpy(y, alpha * x[i], a + i * lda, n);
+		}
+	}
+}
+
+void nn::math::ger(size_t m, size_t n, float alpha, const float* x, const float* y, float* a, size_t lda)
 {
-	for (size_t i = 0; i < num; i++)
+	auto& kernels = simd::kernels();
+
+	for (size_t i = 0; i < m; i++)
 	{
-		left[i] += right[i];
+		if (x[i] != 0.0f)
+			kernels.axpy(a + i * lda, alpha * x[i], y, n);
 	}
 }
 
@@ -55,10 +765,10 @@ void nn::math::rand_matrix(matrix& m, float min, float max)
 	std::mt19937 mt(rd());
 	std::uniform_real_distribution dist(min, max);
 
-	for (size_t i = 0; i < m.width() * m.height(); i++)
-	{
-		m.data()[i] = dist(mt);
-	}
+	m.for_each([&dist, &mt](size_t, size_t, float& num)
+		{
+			num = dist(mt);
+		});
 }
 
 void nn::math::rand_tensor(tensor& t, float min, float max)
@@ -134,7 +844,7 @@ nn::matrix nn::math::conv_2d(const nn::matrix& src, const nn::matrix& kernal, si
 	return out;
 }
 
-void nn::math::conv_2d(nn::matrix& dst, const nn::matrix& src, const nn::matrix& kernal, size_t stride, size_t padding)
+void nn::math::conv_2d_direct(nn::matrix& dst, const nn::matrix& src, const nn::matrix& kernal, size_t stride, size_t padding)
 {
 	// check input parameters
 	if (kernal.width() > src.width() || kernal.height() > src.height())
@@ -187,7 +897,7 @@ nn::matrix nn::math::conv_3d(const nn::tensor& src, const nn::tensor& kernal, si
 	return out;
 }
 
-void nn::math::conv_3d(nn::matrix& dst, const nn::tensor& src, const nn::tensor& kernal, size_t stride, size_t padding)
+void nn::math::conv_3d_direct(nn::matrix& dst, const nn::tensor& src, const nn::tensor& kernal, size_t stride, size_t padding)
 {
 	// check input parameters
 	if (src.channels() != kernal.channels())
@@ -195,9 +905,6 @@ void nn::math::conv_3d(nn::matrix& dst, const nn::tensor& src, const nn::tensor&
 	if (stride == 0)
 		throw nn::numeric_exception("(conv)stride should be larger than 0", __FUNCTION__, __LINE__);
 
-	size_t output_w = (src.width() - kernal.width() + padding * 2 + 1) / stride;
-	size_t output_h = (src.height() - kernal.height() + padding * 2 + 1) / stride;
-
 	dst.fill(0.0f);
 
 	// 3d conv
@@ -221,6 +928,190 @@ void nn::math::conv_3d(nn::matrix& dst, const nn::tensor& src, const nn::tensor&
 	}
 }
 
+void nn::math::conv_2d_fft(nn::matrix& dst, const nn::matrix& src, const nn::matrix& kernal, size_t stride, size_t padding)
+{
+	conv_helper::check_conv(dst, src.width(), src.height(), kernal.width(), kernal.height(), stride, padding);
+
+	if (dst.width() == 0 || dst.height() == 0)
+		return;
+
+	size_t nx, ny;
+	fft_helper::transform_size(src.width(), src.height(), kernal.width(), kernal.height(), dst.width(), dst.height(), stride, padding, nx, ny);
+
+	const auto& kernal_spectrum = fft_helper::kernal_spectrum(kernal, nx, ny);
+
+	thread_local std::vector<float> padded;
+	thread_local std::vector<fft_helper::complex> spectrum;
+
+	// zero-padded source, placed at (padding, padding)
+	padded.assign(nx * ny, 0.0f);
+	for (size_t y = 0; y < src.height(); y++)
+		std::copy(src.row(y), src.row(y) + src.width(), padded.data() + (y + padding) * nx + padding);
+
+	spectrum.resize(ny * (nx / 2 + 1));
+	fft_helper::rfft2(padded.data(), nx, ny, spectrum.data());
+
+	for (size_t i = 0; i < spectrum.size(); i++)
+		spectrum[i] = fft_helper::mul(spectrum[i], kernal_spectrum[i]);
+
+	fft_helper::irfft2(spectrum.data(), nx, ny, padded.data());
+
+	// full-resolution correlation, pick every stride-th sample
+	for (size_t y = 0; y < dst.height(); y++)
+	{
+		const float* row = padded.data() + y * stride * nx;
+		float* dst_row = dst.row(y);
+
+		for (size_t x = 0; x < dst.width(); x++)
+			dst_row[x] = row[x * stride];
+	}
+}
+
+void nn::math::conv_2d(nn::matrix& dst, const nn::matrix& src, const nn::matrix& kernal, size_t stride, size_t padding)
+{
+	conv_helper::check_conv(dst, src.width(), src.height(), kernal.width(), kernal.height(), stride, padding);
+
+	if (fft_helper::fft_cheaper(src.width(), src.height(), kernal.width(), kernal.height(), dst.width(), dst.height(), stride, padding))
+	{
+		conv_2d_fft(dst, src, kernal, stride, padding);
+		return;
+	}
+
+	const size_t taps = kernal.width() * kernal.height();
+	const size_t rows_per_block = conv_helper::rows_per_block(taps, dst.width());
+	const float* taps_data = conv_helper::dense_kernal(kernal);
+
+	for (size_t y0 = 0; y0 < dst.height(); y0 += rows_per_block)
+	{
+		size_t rows = std::min(rows_per_block, dst.height() - y0);
+		size_t pixels = rows * dst.width();
+
+		float* columns = conv_helper::get_columns(taps * pixels);
+		conv_helper::im2col(src.data(), src.width(), src.height(), src.stride(), kernal.width(), kernal.height(), stride, padding, dst.width(), y0, rows, columns);
+
+		// dst(pixels) = columns^T(pixels*taps) * kernal(taps)
+		float* out = conv_helper::output_rows(dst, y0, rows);
+		gemv(true, taps, pixels, 1.0f, columns, pixels, taps_data, 0.0f, out);
+		conv_helper::store_rows(dst, y0, rows, out);
+	}
+}
+
+void nn::math::conv_2d(std::vector<nn::matrix>& dst, const nn::matrix& src, const std::vector<nn::matrix>& kernals, size_t stride, size_t padding)
+{
+	if (dst.size() != kernals.size())
+		throw nn::numeric_exception("kernal count and DST count mismatch", __FUNCTION__, __LINE__);
+	if (kernals.empty())
+		return;
+
+	const size_t kw = kernals[0].width(), kh = kernals[0].height();
+	const size_t taps = kw * kh, count = kernals.size();
+
+	for (size_t i = 0; i < count; i++)
+	{
+		if (kernals[i].width() != kw || kernals[i].height() != kh)
+			throw nn::numeric_exception("kernals should have the same size", __FUNCTION__, __LINE__);
+		conv_helper::check_conv(dst[i], src.width(), src.height(), kw, kh, stride, padding);
+	}
+
+	const size_t out_w = dst[0].width(), out_h = dst[0].height();
+	const size_t rows_per_block = conv_helper::rows_per_block(taps, out_w);
+
+	// kernals packed as a count*taps matrix, one kernal per row
+	auto& packed = conv_helper::packed_kernals;
+	packed.resize(count * taps);
+	for (size_t i = 0; i < count; i++)
+		kernals[i].copy_to(packed.data() + i * taps);
+
+	for (size_t y0 = 0; y0 < out_h; y0 += rows_per_block)
+	{
+		size_t rows = std::min(rows_per_block, out_h - y0);
+		size_t pixels = rows * out_w;
+
+		float* columns = conv_helper::get_columns(taps * pixels);
+		conv_helper::im2col(src.data(), src.width(), src.height(), src.stride(), kw, kh, stride, padding, out_w, y0, rows, columns);
+
+		// out(count*pixels) = kernals(count*taps) * columns(taps*pixels)
+		auto& out = conv_helper::output;
+		out.resize(count * pixels);
+		gemm(false, false, count, pixels, taps, 1.0f, packed.data(), taps, columns, pixels, 0.0f, out.data(), pixels);
+
+		for (size_t i = 0; i < count; i++)
+			conv_helper::store_rows(dst[i], y0, rows, out.data() + i * pixels);
+	}
+}
+
+void nn::math::conv_3d(nn::matrix& dst, const nn::tensor& src, const nn::tensor& kernal, size_t stride, size_t padding)
+{
+	// check input parameters
+	if (src.channels() != kernal.channels())
+		throw nn::numeric_exception("channel count mismatch", __FUNCTION__, __LINE__);
+	conv_helper::check_conv(dst, src.width(), src.height(), kernal.width(), kernal.height(), stride, padding);
+
+	const size_t channel_taps = kernal.width() * kernal.height();
+	const size_t taps = channel_taps * src.channels();
+	const size_t rows_per_block = conv_helper::rows_per_block(taps, dst.width());
+
+	// kernal taps back to back, CHW
+	auto& packed = conv_helper::packed_kernals;
+	packed.resize(taps);
+	kernal.copy_to(packed.data());
+
+	for (size_t y0 = 0; y0 < dst.height(); y0 += rows_per_block)
+	{
+		size_t rows = std::min(rows_per_block, dst.height() - y0);
+		size_t pixels = rows * dst.width();
+
+		// stack the columns of every channel, matching the CHW layout of the kernal tensor
+		float* columns = conv_helper::get_columns(taps * pixels);
+		for (size_t c = 0; c < src.channels(); c++)
+		{
+			conv_helper::im2col(src.channel(c).data(), src.width(), src.height(), src.stride(), kernal.width(), kernal.height(), stride, padding,
+				dst.width(), y0, rows, columns + c * channel_taps * pixels);
+		}
+
+		float* out = conv_helper::output_rows(dst, y0, rows);
+		gemv(true, taps, pixels, 1.0f, columns, pixels, packed.data(), 0.0f, out);
+		conv_helper::store_rows(dst, y0, rows, out);
+	}
+}
+
+void nn::math::winograd_transform_kernal(const nn::matrix& kernal, float* transformed)
+{
+	if (kernal.width() != 3 || kernal.height() != 3)
+		throw nn::numeric_exception("winograd F(2x2,3x3) requires a 3x3 kernal", __FUNCTION__, __LINE__);
+
+	const float* g0 = kernal.row(0), * g1 = kernal.row(1), * g2 = kernal.row(2);
+	float t[12]; // G * g, 4x3
+
+	for (size_t c = 0; c < 3; c++)
+	{
+		t[c] = g0[c];
+		t[3 + c] = 0.5f * (g0[c] + g1[c] + g2[c]);
+		t[6 + c] = 0.5f * (g0[c] - g1[c] + g2[c]);
+		t[9 + c] = g2[c];
+	}
+
+	// U = (G * g) * G^T, 4x4
+	for (size_t r = 0; r < 4; r++)
+	{
+		const float* row = t + r * 3;
+		transformed[r * 4] = row[0];
+		transformed[r * 4 + 1] = 0.5f * (row[0] + row[1] + row[2]);
+		transformed[r * 4 + 2] = 0.5f * (row[0] - row[1] + row[2]);
+		transformed[r * 4 + 3] = row[2];
+	}
+}
+
+void nn::math::conv_2d_winograd(nn::matrix& dst, const nn::matrix& src, const float* transformed, size_t padding)
+{
+	winograd_helper::conv(&dst, 1, src, transformed, padding);
+}
+
+void nn::math::conv_2d_winograd(std::vector<nn::matrix>& dst, const nn::matrix& src, const float* transformed, size_t padding)
+{
+	winograd_helper::conv(dst.data(), dst.size(), src, transformed, padding);
+}
+
 int nn::math::reverse_order_int(int x)
 {
 	return 
@@ -230,21 +1121,49 @@ int nn::math::reverse_order_int(int x)
 		| (0x000000ff & x) << 24;
 }
 
+//== layout helper functions, local
+
+namespace layout_helper
+{
+	// rows rows of w floats between buffers with their own row pitch, one memcpy when both are laid out the same
+	void copy_rows(float* dst, size_t dst_stride, const float* src, size_t src_stride, size_t w, size_t rows)
+	{
+		if (dst_stride == src_stride)
+		{
+			memcpy(dst, src, sizeof(float) * (rows ? (rows - 1) * src_stride + w : 0));
+			return;
+		}
+
+		for (size_t y = 0; y < rows; y++)
+			memcpy(dst + y * dst_stride, src + y * src_stride, sizeof(float) * w);
+	}
+
+	// zero the padding floats after each row, so they never hold garbage (eg. NaN) that full-width loops pick up
+	void clear_padding(float* data, size_t stride, size_t w, size_t rows)
+	{
+		if (stride == w)
+			return;
+
+		for (size_t y = 0; y < rows; y++)
+			std::fill(data + y * stride + w, data + (y + 1) * stride, 0.0f);
+	}
+}
+
 nn::vector::vector()
 {
 	vector_size = 0;
 	vector_data = nullptr;
+	alloc = nullptr;
 }
 
-nn::vector::vector(size_t size) : vector_size(size)
+nn::vector::vector(size_t size)
 {
-	vector_data = new float[size];
+	allocate(size);
 }
 
 nn::vector::vector(std::initializer_list<float> initializer)
 {
-	vector_size = initializer.size();
-	vector_data = new float[vector_size];
+	allocate(initializer.size());
 
 	for (size_t i = 0; i < vector_size; i++)
 	{
@@ -254,8 +1173,7 @@ nn::vector::vector(std::initializer_list<float> initializer)
 
 nn::vector::vector(const vector& src)
 {
-	vector_size = src.vector_size;
-	vector_data = new float[vector_size];
+	allocate(src.vector_size);
 
 	//copy data from source
 	memcpy(vector_data, src.vector_data, sizeof(float) * vector_size);
@@ -265,13 +1183,27 @@ nn::vector::vector(vector&& src) noexcept
 {
 	vector_size = src.vector_size;
 	vector_data = src.vector_data;
+	alloc = src.alloc;
 	src.vector_data = nullptr; // set data to nullptr, releasing the memory
 }
 
 nn::vector::~vector()
+{
+	release();
+}
+
+void nn::vector::allocate(size_t size)
+{
+	vector_size = size;
+	alloc = &get_allocator();
+	vector_data = alloc->allocate(size);
+}
+
+void nn::vector::release()
 {
 	if (vector_data)
-		delete[] vector_data;
+		alloc->deallocate(vector_data, vector_size);
+	vector_data = nullptr;
 }
 
 size_t nn::vector::size() const
@@ -291,6 +1223,11 @@ float* nn::vector::data()
 	return vector_data;
 }
 
+const float* nn::vector::data() const
+{
+	return vector_data;
+}
+
 void nn::vector::fill(float num)
 {
 	for (size_t i = 0; i < vector_size; i++)
@@ -323,9 +1260,8 @@ nn::vector& nn::vector::operator=(const nn::vector& src)
 {
 	if (vector_size != src.vector_size)
 	{
-		delete[] vector_data;
-		vector_size = src.vector_size;
-		vector_data = new float[vector_size];
+		release();
+		allocate(src.vector_size);
 	}
 
 	memcpy(vector_data, src.vector_data, sizeof(float) * vector_size);
@@ -335,9 +1271,13 @@ nn::vector& nn::vector::operator=(const nn::vector& src)
 
 nn::vector& nn::vector::operator =(nn::vector&& src) noexcept
 {
-	delete[] vector_data;
+	if (this == &src)
+		return *this;
+
+	release();
 	vector_size = src.vector_size;
 	vector_data = src.vector_data;
+	alloc = src.alloc;
 
 	src.vector_data = nullptr;
 
@@ -348,9 +1288,8 @@ nn::vector& nn::vector::operator =(std::initializer_list<float> list)
 {
 	if (list.size() != vector_size)
 	{
-		delete[] vector_data;
-		vector_size = list.size();
-		vector_data = new float[vector_size];
+		release();
+		allocate(list.size());
 	}
 
 	for (size_t i = 0; i < vector_size; i++)
@@ -427,49 +1366,71 @@ nn::matrix::matrix()
 {
 	w = 0;
 	h = 0;
+	pitch = 0;
 	matrix_data = nullptr;
+	owns_data = true;
+	alloc = nullptr;
 }
 
-nn::matrix::matrix(size_t w, size_t h) :w(w), h(h)
+nn::matrix::matrix(size_t w, size_t h)
 {
-	matrix_data = new float[w * h];
+	allocate(w, h);
 }
 
-nn::matrix::matrix(size_t w, size_t h, std::initializer_list<float> val) : w(w), h(h)
+nn::matrix::matrix(size_t w, size_t h, std::initializer_list<float> val)
 {
 	if (val.size() != w * h)
 		throw nn::numeric_exception("initializer value count mismatch!", __FUNCTION__, __LINE__);
-	matrix_data = new float[w * h];
+	allocate(w, h);
+	copy_from(val.begin());
+}
 
-	for (size_t i = 0; i < w * h; i++)
-	{
-		matrix_data[i] = *(val.begin() + i);
-	}
+nn::matrix::matrix(size_t w, size_t h, float* external, size_t stride) : w(w), h(h), pitch(stride ? stride : w), matrix_data(external), owns_data(false), alloc(nullptr)
+{
+	_ASSERT(pitch >= w);
 }
 
 nn::matrix::matrix(const matrix& src)
 {
-	w = src.w;
-	h = src.h;
-
-	matrix_data = new float[w * h];
+	allocate(src.w, src.h);
 
-	memcpy(matrix_data, src.matrix_data, sizeof(float) * w * h);
+	layout_helper::copy_rows(matrix_data, pitch, src.matrix_data, src.pitch, w, h);
 }
 
 nn::matrix::matrix(matrix&& src) noexcept
 {
 	w = src.w;
 	h = src.h;
+	pitch = src.pitch;
 	matrix_data = src.matrix_data;
+	owns_data = src.owns_data; // moving a view yields a view
+	alloc = src.alloc;
 
 	src.matrix_data = nullptr;
 }
 
 nn::matrix::~matrix()
 {
-	if (matrix_data)
-		delete[] matrix_data;
+	release();
+}
+
+void nn::matrix::allocate(size_t w, size_t h)
+{
+	this->w = w;
+	this->h = h;
+	pitch = math::row_stride(w);
+	owns_data = true;
+	alloc = &get_allocator();
+	matrix_data = alloc->allocate(pitch * h);
+
+	layout_helper::clear_padding(matrix_data, pitch, w, h);
+}
+
+void nn::matrix::release()
+{
+	if (matrix_data && owns_data)
+		alloc->deallocate(matrix_data, pitch * h);
+	matrix_data = nullptr;
 }
 
 size_t nn::matrix::width() const
@@ -482,18 +1443,23 @@ size_t nn::matrix::height() const
 	return h;
 }
 
+size_t nn::matrix::stride() const
+{
+	return pitch;
+}
+
 float& nn::matrix::at(size_t x, size_t y)
 {
 	_ASSERT(x < w && y < h);
 
-	return matrix_data[y * w + x];
+	return matrix_data[y * pitch + x];
 }
 
 float nn::matrix::at(size_t x, size_t y) const
 {
 	_ASSERT(x < w && y < h);
 
-	return matrix_data[y * w + x];
+	return matrix_data[y * pitch + x];
 }
 
 float* nn::matrix::data()
@@ -501,31 +1467,78 @@ float* nn::matrix::data()
 	return matrix_data;
 }
 
+const float* nn::matrix::data() const
+{
+	return matrix_data;
+}
+
+float* nn::matrix::row(size_t y)
+{
+	_ASSERT(y < h);
+
+	return matrix_data + y * pitch;
+}
+
+const float* nn::matrix::row(size_t y) const
+{
+	_ASSERT(y < h);
+
+	return matrix_data + y * pitch;
+}
+
+bool nn::matrix::is_view() const
+{
+	return !owns_data;
+}
+
+void nn::matrix::rebind(float* external, size_t stride)
+{
+	release();
+
+	matrix_data = external;
+	pitch = stride ? stride : w;
+	owns_data = false;
+
+	_ASSERT(pitch >= w);
+}
+
 nn::matrix& nn::matrix::operator=(const matrix& src)
 {
+	if (this == &src)
+		return *this;
+
 	if (w != src.w || h != src.h)
 	{
-		delete[] matrix_data;
-
-		w = src.w;
-		h = src.h;
+		if (!owns_data)
+			throw logic_exception("can't resize a matrix view", __FUNCTION__, __LINE__);
 
-		matrix_data = new float[w * h];
+		release();
+		allocate(src.w, src.h);
 	}
 
-	memcpy(matrix_data, src.matrix_data, sizeof(float) * w * h);
+	layout_helper::copy_rows(matrix_data, pitch, src.matrix_data, src.pitch, w, h);
 
 	return *this;
 }
 
-nn::matrix& nn::matrix::operator=(matrix&& src) noexcept
+nn::matrix& nn::matrix::operator=(matrix&& src)
 {
-	delete[] matrix_data;
+	if (this == &src)
+		return *this;
+
+	// a view keeps pointing at its memory, data is copied instead of stolen
+	if (!owns_data)
+		return *this = static_cast<const matrix&>(src);
+
+	release();
 	
 	w = src.w;
 	h = src.h;
+	pitch = src.pitch;
 	
 	matrix_data = src.matrix_data;
+	owns_data = src.owns_data;
+	alloc = src.alloc;
 	src.matrix_data = nullptr;
 
 	return *this;
@@ -536,12 +1549,19 @@ void nn::matrix::operator+=(const matrix& src)
 	if (w != src.w || h != src.h)
 		throw numeric_exception("matrix size mismatch", __FUNCTION__, __LINE__);
 
-	math::add(matrix_data, src.matrix_data, w * h);
+	if (pitch == src.pitch) // same layout, one full-width pass over the padded rows
+	{
+		math::add(matrix_data, const_cast<float*>(src.matrix_data), pitch * h);
+		return;
+	}
+
+	for (size_t y = 0; y < h; y++)
+		math::add(row(y), const_cast<float*>(src.row(y)), w);
 }
 
 void nn::matrix::operator+=(float num)
 {
-	math::add(matrix_data, num, w * h);
+	math::add(matrix_data, num, pitch * h);
 }
 
 std::string nn::matrix::to_string() const
@@ -565,38 +1585,47 @@ std::string nn::matrix::to_string() const
 
 void nn::matrix::fill(float num)
 {
-	for (size_t i = 0; i < w * h; i++)
-	{
-		matrix_data[i] = num;
-	}
+	std::fill(matrix_data, matrix_data + pitch * h, num);
 }
 
 nn::vector nn::matrix::to_vector() const
 {
 	nn::vector v(w * h);
-	memcpy(v.data(), matrix_data, sizeof(float) * w * h);
+	copy_to(v.data());
 
 	return v;
 }
 
+void nn::matrix::copy_to(float* dst) const
+{
+	layout_helper::copy_rows(dst, w, matrix_data, pitch, w, h);
+}
+
+void nn::matrix::copy_from(const float* src)
+{
+	layout_helper::copy_rows(matrix_data, pitch, src, w, w, h);
+}
+
 void nn::matrix::for_each(std::function<void(size_t, size_t, float&)> func)
 {
-	for (size_t x = 0; x < w; x++)
-		for (size_t y = 0; y < h; y++)
-			func(x, y, matrix_data[y * w + x]);
+	for (size_t y = 0; y < h; y++)
+		for (size_t x = 0; x < w; x++)
+			func(x, y, matrix_data[y * pitch + x]);
 }
 
 nn::tensor::tensor()
 {
-	c = w = h = 0;
+	c = w = h = pitch = 0;
+	tensor_data = nullptr;
+	alloc = nullptr;
 }
 
-nn::tensor::tensor(size_t c, size_t w, size_t h) :c(c), w(w), h(h)
+nn::tensor::tensor(size_t c, size_t w, size_t h) :c(c), w(w), h(h), pitch(math::row_stride(w))
 {
-	for (size_t i = 0; i < c; i++)
-	{
-		matrices.push_back(matrix(w, h));
-	}
+	alloc = &get_allocator();
+	tensor_data = alloc->allocate(c * h * pitch);
+	layout_helper::clear_padding(tensor_data, pitch, w, c * h);
+	make_views();
 }
 
 nn::tensor::tensor(const tensor& src)
@@ -604,8 +1633,12 @@ nn::tensor::tensor(const tensor& src)
 	c = src.c;
 	w = src.w;
 	h = src.h;
+	pitch = src.pitch;
 
-	matrices = src.matrices;
+	alloc = &get_allocator();
+	tensor_data = alloc->allocate(c * h * pitch);
+	memcpy(tensor_data, src.tensor_data, sizeof(float) * c * h * pitch);
+	make_views();
 }
 
 nn::tensor::tensor(tensor&& src) noexcept
@@ -613,13 +1646,33 @@ nn::tensor::tensor(tensor&& src) noexcept
 	c = src.c;
 	w = src.w;
 	h = src.h;
+	pitch = src.pitch;
+
+	// views point into the buffer, so they stay valid when moved along with it
+	tensor_data = src.tensor_data;
+	alloc = src.alloc;
+	matrices = std::move(src.matrices);
 
-	matrices.assign(src.matrices.begin(), src.matrices.end());
+	src.tensor_data = nullptr;
+	src.c = 0;
 }
 
 nn::tensor::~tensor()
 {
 	matrices.clear();
+	if (tensor_data)
+		alloc->deallocate(tensor_data, c * h * pitch);
+}
+
+void nn::tensor::make_views()
+{
+	matrices.clear();
+	matrices.reserve(c);
+
+	for (size_t i = 0; i < c; i++)
+	{
+		matrices.push_back(matrix(w, h, tensor_data + i * h * pitch, pitch));
+	}
 }
 
 size_t nn::tensor::channels() const
@@ -637,14 +1690,23 @@ size_t nn::tensor::width() const
 	return w;
 }
 
+size_t nn::tensor::stride() const
+{
+	return pitch;
+}
+
 float& nn::tensor::at(size_t x, size_t y, size_t channel)
 {
-	return matrices[channel].at(x, y);
+	_ASSERT(x < w && y < h && channel < c);
+
+	return tensor_data[(channel * h + y) * pitch + x];
 }
 
 float nn::tensor::at(size_t x, size_t y, size_t channel) const
 {
-	return matrices[channel].at(x, y);
+	_ASSERT(x < w && y < h && channel < c);
+
+	return tensor_data[(channel * h + y) * pitch + x];
 }
 
 nn::matrix& nn::tensor::channel(size_t channel)
@@ -652,48 +1714,94 @@ nn::matrix& nn::tensor::channel(size_t channel)
 	return matrices[channel];
 }
 
+const nn::matrix& nn::tensor::channel(size_t channel) const
+{
+	return matrices[channel];
+}
+
+float* nn::tensor::data()
+{
+	return tensor_data;
+}
+
+const float* nn::tensor::data() const
+{
+	return tensor_data;
+}
+
+void nn::tensor::copy_to(float* dst) const
+{
+	layout_helper::copy_rows(dst, w, tensor_data, pitch, w, c * h);
+}
+
+void nn::tensor::copy_from(const float* src)
+{
+	layout_helper::copy_rows(tensor_data, pitch, src, w, w, c * h);
+}
+
 nn::tensor& nn::tensor::operator=(const tensor& src)
 {
+	if (this == &src)
+		return *this;
+
+	if (c * h * pitch != src.c * src.h * src.pitch) // re-allocate only if the total size changes
+	{
+		if (tensor_data)
+			alloc->deallocate(tensor_data, c * h * pitch);
+
+		alloc = &get_allocator();
+		tensor_data = alloc->allocate(src.c * src.h * src.pitch);
+	}
+
+	bool reshape = c != src.c || w != src.w || h != src.h || matrices.empty();
+
 	c = src.c;
 	w = src.w;
 	h = src.h;
+	pitch = src.pitch;
 
-	for (size_t i = 0; i < c; i++)
-	{
-		if (i < matrices.size()) // channel exists, try to avoid re-allocating
-			matrices[i] = src.matrices[i];
-		else // channel doesn't exist, creat a new one
-			matrices.push_back(matrix(src.matrices[i]));
-	}
+	memcpy(tensor_data, src.tensor_data, sizeof(float) * c * h * pitch);
 
-	matrices.shrink_to_fit(); // shrink to reduce data usage
+	if (reshape || matrices[0].data() != tensor_data)
+		make_views();
 
 	return *this;
 }
 
 nn::tensor& nn::tensor::operator=(tensor&& src) noexcept
 {
+	if (this == &src)
+		return *this;
+
+	if (tensor_data)
+		alloc->deallocate(tensor_data, c * h * pitch);
+
 	w = src.w;
 	h = src.h;
 	c = src.c;
+	pitch = src.pitch;
 
-	matrices.assign(src.matrices.begin(), src.matrices.end());
+	tensor_data = src.tensor_data;
+	alloc = src.alloc;
+	matrices = std::move(src.matrices);
+
+	src.tensor_data = nullptr;
+	src.c = 0;
 
 	return *this;
 }
 
 void nn::tensor::fill(float num)
 {
-	for (auto& matrix : matrices)
-		matrix.fill(num);
+	std::fill(tensor_data, tensor_data + c * h * pitch, num);
 }
 
 void nn::tensor::for_each(std::function<void(size_t, size_t, size_t, float&)> func)
 {
 	for (size_t channel = 0; channel < c; channel++)
 	{
-		for (size_t x = 0; x < w; x++)
-			for (size_t y = 0; y < h; y++)
+		for (size_t y = 0; y < h; y++)
+			for (size_t x = 0; x < w; x++)
 				func(x, y, channel, at(x, y, channel));
 	}
 }
@@ -6,6 +6,7 @@
 #define NN_MATH_H
 
 #include "nn-exception.h"
+#include "nn-alloc.h"
 
 #include <vector>
 #include <functional>
@@ -13,6 +14,20 @@
 
 namespace nn
 {
+	namespace math
+	{
+		//== Memory layout
+
+		constexpr size_t buffer_alignment = 64; // alignment (bytes) of buffers returned by alloc_buffer and every allocator
+		constexpr size_t row_alignment = buffer_alignment / sizeof(float); // widest SIMD register in floats, row pitch unit
+
+		// row pitch of owning matrices and tensors: w rounded up to row_alignment, so every row starts 64-byte aligned
+		constexpr size_t row_stride(size_t w)
+		{
+			return (w + row_alignment - 1) / row_alignment * row_alignment;
+		}
+	}
+
 	template<typename T>
 	struct search_result
 	{
@@ -24,11 +39,16 @@ namespace nn
 	};
 
 	// a float type vector, 1 dimensional
+	// data comes from the thread's current allocator (see nn-alloc.h)
 	struct vector
 	{
 	private:
 		size_t vector_size;
 		float* vector_data;
+		allocator* alloc; // where vector_data came from
+
+		void allocate(size_t size); // vector_data must be released
+		void release();
 
 	public:
 		vector(); // initialize a placeholder with a size of 0 (invalid vector, don't use unless necessary)
@@ -41,6 +61,7 @@ namespace nn
 		size_t size() const; // dimension of the vector
 		float& operator [](size_t idx) const; // number at the index
 		float* data(); // never use this unless necessary
+		const float* data() const;
 
 		void fill(float num);
 
@@ -59,20 +80,37 @@ namespace nn
 		float sum() const;
 		
 		void for_each(std::function<void(size_t, float&)> func); // execute operation foreach element
+
+		// inlinable version for lambdas and function objects, preferred over the std::function one
+		template<typename F>
+		void for_each(F&& func)
+		{
+			for (size_t i = 0; i < vector_size; i++)
+				func(i, vector_data[i]);
+		}
 	};
 
 	// 2d matrix, float format
+	// a matrix is either owning (allocates its own data) or a view (wraps memory owned by someone else, eg. a tensor channel)
+	// rows are stride() floats apart: owning matrices pad them to math::row_stride(w), views use the stride they were given
+	// padding floats (x >= width) carry no data, element-wise operations may overwrite them
 	struct matrix
 	{
 	private:
-		size_t w, h;
+		size_t w, h, pitch;
 		float* matrix_data;
+		bool owns_data;
+		allocator* alloc; // where owned matrix_data came from
+
+		void allocate(size_t w, size_t h); // matrix_data must be released
+		void release();
 
 	public:
 		matrix();
 		matrix(size_t w, size_t h);
 		matrix(size_t w, size_t h, std::initializer_list<float> val);
-		matrix(const matrix& src);
+		matrix(size_t w, size_t h, float* external, size_t stride = 0); // non-owning view over h rows of stride floats (0: w, dense)
+		matrix(const matrix& src); // always produces an owning copy, even if src is a view
 		matrix(matrix&& src) noexcept;
 		~matrix();
 
@@ -80,10 +118,17 @@ namespace nn
 		size_t height() const; // matrix height
 		float& at(size_t x, size_t y); // number at position(x,y)
 		float at(size_t x, size_t y) const;
-		float* data(); // never use this unless necessary
-
+		size_t stride() const; // floats between the starts of two rows
+		float* data(); // never use this unless necessary, h rows of stride() floats
+		const float* data() const;
+		float* row(size_t y); // first element of row y
+		const float* row(size_t y) const;
+		bool is_view() const; // true if the matrix doesn't own its data
+		void rebind(float* external, size_t stride = 0); // become a view like matrix(w, h, external, stride), owned data is released
+
+		// NOTE: assigning to a view copies into the viewed memory, size must match
 		matrix& operator =(const matrix& src);
-		matrix& operator =(matrix&& src) noexcept;
+		matrix& operator =(matrix&& src); // not noexcept, a view throws on size mismatch like the copy
 
 		void operator +=(const matrix& src);
 		void operator +=(float num);
@@ -93,16 +138,35 @@ namespace nn
 		void fill(float num);
 
 		vector to_vector() const;
-
-		void for_each(std::function<void(size_t, size_t, float&)> func); // execute operation foreach element (x,y)
+		void copy_to(float* dst) const; // w*h floats, dense row-major
+		void copy_from(const float* src); // w*h floats, dense row-major
+
+		void for_each(std::function<void(size_t, size_t, float&)> func); // execute operation foreach element (x,y), row by row
+
+		// inlinable version for lambdas and function objects, same row-major order
+		template<typename F>
+		void for_each(F&& func)
+		{
+			for (size_t y = 0; y < h; y++)
+			{
+				float* line = matrix_data + y * pitch;
+				for (size_t x = 0; x < w; x++)
+					func(x, y, line[x]);
+			}
+		}
 	};
 
-	// 3d tensor structure, consisting of numerous matrices
+	// 3d tensor structure, stored in CHW order in one aligned allocation, rows padded to math::row_stride(w) like matrix
+	// channels are exposed as matrix views into the tensor data
 	struct tensor
 	{
 	private:
-		std::vector<matrix> matrices;
-		size_t c, w, h;
+		float* tensor_data;
+		allocator* alloc; // where tensor_data came from
+		std::vector<matrix> matrices; // views, one per channel
+		size_t c, w, h, pitch;
+
+		void make_views();
 
 	public:
 		tensor();
@@ -116,23 +180,59 @@ namespace nn
 		size_t width() const; // tensor width
 		float& at(size_t x, size_t y, size_t channel); // number at (channel,x,y)
 		float at(size_t x, size_t y, size_t channel) const;
-		matrix& channel(size_t channel); // returns the matrix at given channel
+		matrix& channel(size_t channel); // returns the matrix view at given channel
+		const matrix& channel(size_t channel) const;
+		size_t stride() const; // floats between two rows, channel planes are stride() * height() floats apart
+		float* data(); // CHW data, c*h rows of stride() floats
+		const float* data() const;
+		void copy_to(float* dst) const; // c*h*w floats, dense CHW
+		void copy_from(const float* src); // c*h*w floats, dense CHW
 
 		tensor& operator =(const tensor& src);
 		tensor& operator =(tensor&& src) noexcept;
 
 		void fill(float num);
 
-		void for_each(std::function<void(size_t, size_t, size_t, float&)> func);
+		void for_each(std::function<void(size_t, size_t, size_t, float&)> func); // (x,y,channel), channel by channel, row by row
+
+		// inlinable version for lambdas and function objects, same memory order
+		template<typename F>
+		void for_each(F&& func)
+		{
+			for (size_t channel = 0; channel < c; channel++)
+				for (size_t y = 0; y < h; y++)
+				{
+					float* line = tensor_data + (channel * h + y) * pitch;
+					for (size_t x = 0; x < w; x++)
+						func(x, y, channel, line[x]);
+				}
+		}
 	};
 
 	namespace math
 	{
-		//== Basic algorithms (intended for SIMD accleration)
+		//== Basic algorithms (SIMD accelerated, see nn-simd.h for instruction set selection)
 
 		float dot(float* left, float* right, size_t num); // inner-product of two vectors
 		void add(float* array, float addition, size_t num); // add a specfic number to all elements in array
 		void add(float* left, float* right, size_t num); // add two arrays, per-element
+		void axpy(float* y, float alpha, const float* x, size_t num); // y += alpha * x, per-element
+
+		//== Matrix multiplication (row-major, cache-blocked & register-tiled)
+		// op(X) is X, or X transposed if trans_x is set; ld*: distance in floats between two rows
+
+		// C(m*n) = alpha * op(A)(m*k) * op(B)(k*n) + beta * C
+		void gemm(bool trans_a, bool trans_b, size_t m, size_t n, size_t k, float alpha, const float* a, size_t lda, const float* b, size_t ldb, float beta, float* c, size_t ldc);
+		// y = alpha * op(A) * x + beta * y; A is m*n, y has m (or n if transposed) elements
+		void gemv(bool trans_a, size_t m, size_t n, float alpha, const float* a, size_t lda, const float* x, float beta, float* y);
+		// A(m*n) += alpha * x * y^T
+		void ger(size_t m, size_t n, float alpha, const float* x, const float* y, float* a, size_t lda);
+
+		//== Memory helpers
+
+		float* alloc_buffer(size_t num); // allocate an aligned float buffer, throws memory_exception on failure
+		void free_buffer(float* ptr); // release buffer returned by alloc_buffer
+		size_t buffer_allocations(); // alloc_buffer calls so far on all threads, the heap allocations behind every allocator
 
 		//== Helper functions
 
@@ -149,12 +249,31 @@ namespace nn
 		matrix rotate_matrix_180(const matrix& m);
 
 		//== Convolution
+		// conv_2d/conv_3d lower the input to a column matrix (im2col) and run it through gemm/gemv
+		// *_direct: straightforward nested loops, kept as reference implementation
 
 		nn::matrix conv_2d(const nn::matrix& src, const nn::matrix& kernal, size_t stride = 1, size_t padding = 0);
 		void conv_2d(nn::matrix& dst, const nn::matrix& src, const nn::matrix& kernal, size_t stride = 1, size_t padding = 0);
+		// convolve one source with many kernals (dst[i] = src * kernals[i]), sharing one im2col pass: a single gemm
+		void conv_2d(std::vector<nn::matrix>& dst, const nn::matrix& src, const std::vector<nn::matrix>& kernals, size_t stride = 1, size_t padding = 0);
+		void conv_2d_direct(nn::matrix& dst, const nn::matrix& src, const nn::matrix& kernal, size_t stride = 1, size_t padding = 0);
+		// FFT based, O(N log N) regardless of kernal size. spectra of recently used kernals are cached per thread
+		// conv_2d switches to this automatically for large kernals when it's estimated to be cheaper
+		void conv_2d_fft(nn::matrix& dst, const nn::matrix& src, const nn::matrix& kernal, size_t stride = 1, size_t padding = 0);
 
 		nn::matrix conv_3d(const nn::tensor& src, const nn::tensor& kernal, size_t stride = 1, size_t padding = 0);
 		void conv_3d(nn::matrix& dst, const nn::tensor& src, const nn::tensor& kernal, size_t stride = 1, size_t padding = 0);
+		void conv_3d_direct(nn::matrix& dst, const nn::tensor& src, const nn::tensor& kernal, size_t stride = 1, size_t padding = 0);
+
+		//== Winograd convolution F(2x2,3x3): 3x3 kernals with stride 1 only, 2.25x fewer multiplications than conv_2d_direct
+		// kernals are transformed once (winograd_transform_kernal) and may be reused as long as the kernal doesn't change
+
+		constexpr size_t winograd_kernal_floats = 16; // size of a transformed kernal (4x4)
+
+		void winograd_transform_kernal(const nn::matrix& kernal, float* transformed); // transformed: winograd_kernal_floats floats
+		void conv_2d_winograd(nn::matrix& dst, const nn::matrix& src, const float* transformed, size_t padding = 0);
+		// dst[i] = src * kernal i; transformed: dst.size() transformed kernals, back to back. input tiles are transformed once for all kernals
+		void conv_2d_winograd(std::vector<nn::matrix>& dst, const nn::matrix& src, const float* transformed, size_t padding = 0);
 
 		//== Bit-level operations
 
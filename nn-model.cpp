@@ -0,0 +1,267 @@
+#include "nn-model.h"
+#include "nn-exception.h"
+
+#include <cstring>
+#include <algorithm>
+
+//== model helper functions, local
+
+namespace model_helper
+{
+	constexpr char magic[8] = { 'N', 'N', 'M', 'O', 'D', 'E', 'L', '\0' };
+	constexpr size_t alignment = 64;
+
+	// a * b, false if it doesn't fit in 64 bits
+	bool checked_mul(uint64_t a, uint64_t b, uint64_t& result)
+	{
+		if (b != 0 && a > UINT64_MAX / b)
+			return false;
+
+		result = a * b;
+		return true;
+	}
+
+	// floats of the weight block, from the shape. 0 for an invalid shape: unknown type, zero or unused dimensions set,
+	// or a size that doesn't fit in 64 bits. every dimension that sizes the block is then at most the returned size
+	uint64_t block_size(uint32_t type, const uint64_t(&shape)[4])
+	{
+		uint64_t weights;
+
+		switch (static_cast<nn::model::layer_type>(type))
+		{
+		case nn::model::layer_type::linear:
+			if (shape[0] == 0 || shape[1] == 0 || shape[2] != 0 || shape[3] != 0)
+				return 0;
+			if (!checked_mul(shape[0], shape[1], weights) || weights == UINT64_MAX)
+				return 0;
+			return weights + 1;
+		case nn::model::layer_type::conv2:
+			if (shape[0] == 0 || shape[1] == 0 || shape[2] == 0 || shape[3] == 0)
+				return 0;
+			if (!checked_mul(shape[1], shape[1], weights) || !checked_mul(weights, shape[0], weights) || weights > UINT64_MAX - shape[0])
+				return 0;
+			return weights + shape[0];
+		default:
+			return 0;
+		}
+	}
+
+	// [offset, offset + count * item_size) inside the file, without overflow
+	bool in_file(uint64_t offset, uint64_t count, uint64_t item_size, uint64_t file_size)
+	{
+		if (offset > file_size)
+			return false;
+
+		return count <= (file_size - offset) / item_size;
+	}
+
+	uint64_t linear_shape(nn::hidden_layer::linear_layer& layer, uint64_t(&shape)[4])
+	{
+		shape[0] = layer.get_weights().height();
+		shape[1] = layer.get_weights().width();
+		shape[2] = 0;
+		shape[3] = 0;
+		return block_size(static_cast<uint32_t>(nn::model::layer_type::linear), shape);
+	}
+
+	uint64_t conv2_shape(nn::hidden_layer::conv2_layer& layer, uint64_t(&shape)[4])
+	{
+		shape[0] = layer.depth;
+		shape[1] = layer.kernal_size;
+		shape[2] = layer.w;
+		shape[3] = layer.h;
+		return block_size(static_cast<uint32_t>(nn::model::layer_type::conv2), shape);
+	}
+}
+
+//== model_writer
+
+nn::model::model_writer::model_writer(std::string path) :writer(path)
+{
+	// placeholder, the header is rewritten by commit() once the table offset is known
+	file_header header = {};
+	writer.write(&header, sizeof(header));
+}
+
+void nn::model::model_writer::add(hidden_layer::linear_layer& layer)
+{
+	layer_entry entry = {};
+	entry.type = static_cast<uint32_t>(layer_type::linear);
+	entry.size = model_helper::linear_shape(layer, entry.shape);
+
+	writer.pad_to(model_helper::alignment);
+	entry.offset = writer.position();
+
+	const matrix& weights = layer.get_weights();
+	for (size_t y = 0; y < weights.height(); y++)
+		writer.write(weights.row(y), sizeof(float) * weights.width()); // dense rows, the padding isn't stored
+	writer.write(&layer.get_bias(), sizeof(float));
+
+	table.push_back(entry);
+}
+
+void nn::model::model_writer::add(hidden_layer::conv2_layer& layer)
+{
+	layer_entry entry = {};
+	entry.type = static_cast<uint32_t>(layer_type::conv2);
+	entry.size = model_helper::conv2_shape(layer, entry.shape);
+
+	writer.pad_to(model_helper::alignment);
+	entry.offset = writer.position();
+
+	for (size_t i = 0; i < layer.depth; i++)
+		for (size_t y = 0; y < layer.kernal_size; y++)
+			writer.write(layer.get_kernal(i).row(y), sizeof(float) * layer.kernal_size);
+
+	for (size_t i = 0; i < layer.depth; i++)
+		writer.write(&layer.get_bias(i), sizeof(float));
+
+	table.push_back(entry);
+}
+
+bool nn::model::model_writer::commit()
+{
+	writer.pad_to(model_helper::alignment);
+
+	file_header header = {};
+	memcpy(header.magic, model_helper::magic, sizeof(header.magic));
+	header.version = version;
+	header.header_size = sizeof(file_header);
+	header.num_layers = table.size();
+	header.table_offset = writer.position();
+	header.file_size = header.table_offset + sizeof(layer_entry) * table.size();
+
+	writer.write(table.data(), sizeof(layer_entry) * table.size());
+	writer.write_at(0, &header, sizeof(header));
+
+	return writer.commit();
+}
+
+//== model_file
+
+nn::model::model_file::model_file(std::string path) :file(path)
+{
+	if (file.size() < sizeof(file_header))
+		throw logic_exception("model file too small", __FUNCTION__, __LINE__);
+
+	header = reinterpret_cast<const file_header*>(file.data());
+
+	if (memcmp(header->magic, model_helper::magic, sizeof(header->magic)) != 0)
+		throw logic_exception("not a model file", __FUNCTION__, __LINE__);
+	if (header->version != version || header->header_size != sizeof(file_header))
+		throw logic_exception("model file version mismatch", __FUNCTION__, __LINE__);
+	if (header->file_size != file.size())
+		throw logic_exception("mismatched file size", __FUNCTION__, __LINE__);
+	if (header->table_offset % alignof(layer_entry) != 0 || !model_helper::in_file(header->table_offset, header->num_layers, sizeof(layer_entry), header->file_size))
+		throw logic_exception("layer table out of range", __FUNCTION__, __LINE__);
+
+	table = reinterpret_cast<const layer_entry*>(file.data() + header->table_offset);
+
+	for (size_t i = 0; i < header->num_layers; i++)
+	{
+		const layer_entry& entry = table[i];
+		const uint64_t expected = model_helper::block_size(entry.type, entry.shape);
+
+		if (expected == 0 || entry.size != expected)
+			throw logic_exception("invalid layer entry", __FUNCTION__, __LINE__);
+		if (entry.offset % model_helper::alignment != 0 || !model_helper::in_file(entry.offset, entry.size, sizeof(float), header->table_offset))
+			throw logic_exception("weight block out of range", __FUNCTION__, __LINE__);
+	}
+}
+
+size_t nn::model::model_file::num_layers() const
+{
+	return header->num_layers;
+}
+
+const nn::model::layer_entry& nn::model::model_file::get_entry(size_t index) const
+{
+	if (index >= num_layers())
+		throw logic_exception("layer index out of range", __FUNCTION__, __LINE__);
+
+	return table[index];
+}
+
+const float* nn::model::model_file::get_data(size_t index) const
+{
+	return reinterpret_cast<const float*>(file.data() + get_entry(index).offset);
+}
+
+const nn::model::layer_entry& nn::model::model_file::check_entry(size_t index, layer_type type, const uint64_t(&shape)[4]) const
+{
+	const layer_entry& entry = get_entry(index);
+
+	if (entry.type != static_cast<uint32_t>(type))
+		throw numeric_exception("layer type mismatch", __FUNCTION__, __LINE__);
+	if (!std::equal(shape, shape + 4, entry.shape))
+		throw numeric_exception("layer shape mismatch", __FUNCTION__, __LINE__);
+
+	return entry;
+}
+
+void nn::model::model_file::load(size_t index, hidden_layer::linear_layer& layer) const
+{
+	uint64_t shape[4];
+	model_helper::linear_shape(layer, shape);
+	check_entry(index, layer_type::linear, shape);
+
+	const float* data = get_data(index);
+	const size_t num = shape[0] * shape[1];
+
+	matrix& weights = layer.get_weights();
+	if (weights.is_view())
+		throw logic_exception("layer weights are mapped, load into a fresh layer", __FUNCTION__, __LINE__);
+
+	weights.copy_from(data);
+	layer.get_bias() = data[num];
+}
+
+void nn::model::model_file::load(size_t index, hidden_layer::conv2_layer& layer) const
+{
+	uint64_t shape[4];
+	model_helper::conv2_shape(layer, shape);
+	check_entry(index, layer_type::conv2, shape);
+
+	const float* data = get_data(index);
+	const size_t kernal_floats = layer.kernal_size * layer.kernal_size;
+
+	for (size_t i = 0; i < layer.depth; i++)
+	{
+		matrix& kernal = layer.get_kernal(i);
+		if (kernal.is_view())
+			throw logic_exception("layer weights are mapped, load into a fresh layer", __FUNCTION__, __LINE__);
+
+		kernal.copy_from(data + i * kernal_floats);
+	}
+
+	for (size_t i = 0; i < layer.depth; i++)
+		layer.get_bias(i) = data[layer.depth * kernal_floats + i];
+}
+
+void nn::model::model_file::map(size_t index, hidden_layer::linear_layer& layer) const
+{
+	uint64_t shape[4];
+	model_helper::linear_shape(layer, shape);
+	check_entry(index, layer_type::linear, shape);
+
+	const float* data = get_data(index);
+
+	layer.get_weights().rebind(const_cast<float*>(data));
+	layer.get_bias() = data[shape[0] * shape[1]];
+}
+
+void nn::model::model_file::map(size_t index, hidden_layer::conv2_layer& layer) const
+{
+	uint64_t shape[4];
+	model_helper::conv2_shape(layer, shape);
+	check_entry(index, layer_type::conv2, shape);
+
+	const float* data = get_data(index);
+	const size_t kernal_floats = layer.kernal_size * layer.kernal_size;
+
+	for (size_t i = 0; i < layer.depth; i++)
+		layer.get_kernal(i).rebind(const_cast<float*>(data + i * kernal_floats));
+
+	for (size_t i = 0; i < layer.depth; i++)
+		layer.get_bias(i) = data[layer.depth * kernal_floats + i];
+}
@@ -0,0 +1,98 @@
+// FILENAME: nn-model.h
+// Binary model files: header, layer table and 64-byte aligned raw weight blocks
+// A model can be loaded by copying, or memory-mapped with the layers using the weights in place (inference only)
+
+#ifndef NN_MODEL_H
+#define NN_MODEL_H
+
+#include "nn-layer.h"
+#include "nn-file.h"
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+namespace nn::model
+{
+	/*
+	FILE LAYOUT (version 1, little-endian):
+
+	file_header
+	weight blocks, one per layer, each 64-byte aligned:
+		linear: weights (num_neurons rows of num_weights floats), then the bias (1 float)
+		conv2: depth kernals (kernal_size * kernal_size floats each, row-major), then depth biases
+	layer table: num_layers layer_entry, in the order the layers were added
+	*/
+
+	constexpr unsigned int version = 1;
+
+	enum class layer_type : uint32_t
+	{
+		linear = 1,
+		conv2 = 2
+	};
+
+	struct file_header
+	{
+		char magic[8]; // "NNMODEL\0"
+		uint32_t version;
+		uint32_t header_size; // sizeof(file_header)
+		uint64_t num_layers;
+		uint64_t table_offset; // bytes from the start of the file
+		uint64_t file_size;
+	};
+
+	struct layer_entry
+	{
+		uint32_t type; // layer_type
+		uint32_t reserved;
+		uint64_t shape[4]; // linear: {num_neurons, num_weights, 0, 0}; conv2: {depth, kernal_size, w, h}
+		uint64_t offset; // weight block, bytes from the start of the file
+		uint64_t size; // floats in the weight block
+	};
+
+	// writes layers in order, the file is complete after commit()
+	class model_writer
+	{
+	private:
+		file::binary_writer writer;
+		std::vector<layer_entry> table;
+
+	public:
+		model_writer(std::string path); // throws logic_exception if the file can't be created
+
+		void add(hidden_layer::linear_layer& layer);
+		void add(hidden_layer::conv2_layer& layer);
+
+		bool commit(); // write the table and header, return true if success
+	};
+
+	// memory-mapped model file, checked on open. layers are restored by index, in the order they were written
+	class model_file
+	{
+	private:
+		file::mapped_file file;
+		const file_header* header;
+		const layer_entry* table;
+
+		const layer_entry& check_entry(size_t index, layer_type type, const uint64_t(&shape)[4]) const;
+
+	public:
+		model_file(std::string path); // throws logic_exception if the file is missing, damaged or of another version
+
+		size_t num_layers() const;
+		const layer_entry& get_entry(size_t index) const;
+		const float* get_data(size_t index) const; // weight block of layer[index], get_entry(index).size floats
+
+		// copy weights into the layer; the layer shape must match the file, otherwise throws numeric_exception
+		void load(size_t index, hidden_layer::linear_layer& layer) const;
+		void load(size_t index, hidden_layer::conv2_layer& layer) const;
+
+		// point the layer's weights into the mapping, nothing is copied. the pages are read-only: inference only,
+		// the model_file must outlive the layer. biases are copied
+		void map(size_t index, hidden_layer::linear_layer& layer) const;
+		void map(size_t index, hidden_layer::conv2_layer& layer) const;
+	};
+}
+
+#endif
@@ -0,0 +1,153 @@
+// FILENAME: nn-parallel.h
+// Data-parallel mini-batch training on the thread pool
+// Each worker runs forward/backward on a shard of the batch in its own network replica, gradients are then reduced into the master
+
+#ifndef NN_PARALLEL_H
+#define NN_PARALLEL_H
+
+#include "nn-layer.h"
+#include "nn-thread.h"
+
+#include <vector>
+#include <memory>
+#include <cstring>
+
+namespace nn
+{
+	// network_T: a base_network<..., ...> implementing the batch and split-update interface, default constructible
+	// the master network is the one being trained; replicas only hold copies of its weights and private gradient buffers
+	template<typename network_T>
+	class data_parallel_trainer
+	{
+	private:
+		network_T& master;
+		std::vector<std::unique_ptr<network_T>> replicas; // replica 0 is the master itself, not stored here
+		std::vector<std::vector<parameter_block>> blocks; // [network][block], network 0: master
+		std::vector<float> shard_loss;
+		thread_pool& pool;
+
+		size_t num_networks() const
+		{
+			return replicas.size() + 1;
+		}
+
+		network_T& network(size_t index)
+		{
+			return index == 0 ? master : *replicas[index - 1];
+		}
+
+		// master weights -> replicas
+		void broadcast_weights()
+		{
+			pool.parallel_for(1, num_networks(), [this](size_t n)
+				{
+					for (size_t b = 0; b < blocks[0].size(); b++)
+						memcpy(blocks[n][b].values, blocks[0][b].values, sizeof(float) * blocks[0][b].size);
+				});
+		}
+
+		static constexpr size_t slice = 4096; // floats per reduction task
+
+		// replica gradients -> master, in parallel over slices of each block. replica buffers are cleared
+		void reduce_gradients()
+		{
+			for (size_t b = 0; b < blocks[0].size(); b++)
+			{
+				const size_t size = blocks[0][b].size;
+
+				pool.parallel_for(0, (size + slice - 1) / slice, [this, b, size](size_t s)
+					{
+						const size_t first = s * slice, num = std::min(slice, size - first);
+						float* dst = blocks[0][b].gradients + first;
+
+						for (size_t n = 1; n < num_networks(); n++)
+						{
+							float* src = blocks[n][b].gradients + first;
+							math::add(dst, src, num);
+							std::fill(src, src + num, 0.0f);
+						}
+					});
+			}
+		}
+
+	public:
+		// num_workers: number of shards per batch, 0 for one per pool thread plus the calling thread
+		data_parallel_trainer(network_T& master, size_t num_workers = 0, thread_pool& pool = thread_pool::global()) :master(master), pool(pool)
+		{
+			if (num_workers == 0)
+				num_workers = pool.size() + 1;
+
+			for (size_t i = 1; i < num_workers; i++)
+				replicas.push_back(std::make_unique<network_T>());
+
+			blocks.resize(num_networks());
+			for (size_t n = 0; n < num_networks(); n++)
+			{
+				network(n).get_parameters(blocks[n]);
+
+				if (blocks[n].size() != blocks[0].size())
+					throw logic_exception("replica parameter layout mismatch", __FUNCTION__, __LINE__);
+			}
+
+			shard_loss.resize(num_networks());
+			sync();
+		}
+
+		// copy master weights to the replicas. call after changing the master's weights outside of train_batch
+		void sync()
+		{
+			for (size_t n = 1; n < num_networks(); n++)
+				network(n).learning_rate = master.learning_rate;
+
+			broadcast_weights();
+		}
+
+		size_t get_num_workers() const
+		{
+			return num_networks();
+		}
+
+		// one sgd step over the batch (one sample per row), same result as the master's update_weights_batch up to rounding
+		// returns the average loss of the batch
+		float train_batch(const matrix& inputs, const matrix& targets)
+		{
+			if (inputs.height() != targets.height())
+				throw logic_exception("input and target count mismatch", __FUNCTION__, __LINE__);
+
+			const size_t batch_size = inputs.height();
+			const size_t shards = std::min(num_networks(), batch_size);
+
+			if (shards == 0)
+				return 0.0f;
+
+			pool.parallel_for(0, shards, [&](size_t s)
+				{
+					const size_t first = batch_size * s / shards, last = batch_size * (s + 1) / shards;
+					auto& net = network(s);
+
+					// read-only views over this shard's rows
+					matrix shard_inputs(inputs.width(), last - first, const_cast<float*>(inputs.row(first)), inputs.stride());
+					matrix shard_targets(targets.width(), last - first, const_cast<float*>(targets.row(first)), targets.stride());
+
+					net.feed_batch(shard_inputs);
+					net.forward_and_grad_batch(shard_targets);
+					net.backward_batch();
+					net.accumulate_gradients_batch();
+
+					shard_loss[s] = net.get_loss() * (last - first);
+				});
+
+			reduce_gradients();
+			master.apply_gradients(1.0f / batch_size);
+			broadcast_weights();
+
+			float loss = 0.0f;
+			for (size_t s = 0; s < shards; s++)
+				loss += shard_loss[s];
+
+			return loss / batch_size;
+		}
+	};
+}
+
+#endif
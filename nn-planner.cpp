@@ -0,0 +1,217 @@
+#include "nn-planner.h"
+#include "nn-exception.h"
+
+#include <cstring>
+#include <algorithm>
+
+//== planner helper functions, local
+
+namespace planner_helper
+{
+	// get_map / get_gradient of every depth index
+	template<typename layer_T, typename get_T>
+	std::vector<nn::matrix*> collect(layer_T& layer, get_T get)
+	{
+		std::vector<nn::matrix*> matrices(layer.depth);
+		for (size_t d = 0; d < layer.depth; d++)
+			matrices[d] = &(layer.*get)(d);
+		return matrices;
+	}
+}
+
+nn::memory_planner::memory_planner(mode m) :plan_mode(m)
+{
+}
+
+nn::memory_planner::~memory_planner()
+{
+	math::free_buffer(arena);
+}
+
+void nn::memory_planner::add_buffer(std::vector<matrix*> matrices, buffer_kind kind)
+{
+	if (arena)
+		throw logic_exception("planner is already bound", __FUNCTION__, __LINE__);
+
+	buffer b;
+	b.kind = kind;
+	b.layer = num_layers;
+	b.size = 0;
+
+	for (matrix* m : matrices)
+	{
+		const size_t floats = m->stride() * m->height(); // padded rows keep their layout in the arena
+		b.size += math::row_stride(floats); // next matrix starts 64-byte aligned
+		unplanned_floats += floats;
+	}
+
+	b.matrices = std::move(matrices);
+	buffers.push_back(std::move(b));
+}
+
+void nn::memory_planner::add(hidden_layer::conv2_layer& layer)
+{
+	add_buffer(planner_helper::collect(layer, &hidden_layer::conv2_layer::get_map), buffer_kind::output);
+	add_buffer(planner_helper::collect(layer, &hidden_layer::conv2_layer::get_gradient), buffer_kind::gradient);
+	updated.push_back(true);
+	num_layers++;
+}
+
+void nn::memory_planner::add(hidden_layer::relu_layer& layer)
+{
+	add_buffer(planner_helper::collect(layer, &hidden_layer::relu_layer::get_map), buffer_kind::output);
+	add_buffer(planner_helper::collect(layer, &hidden_layer::relu_layer::get_gradient), buffer_kind::gradient);
+	updated.push_back(false);
+	num_layers++;
+}
+
+void nn::memory_planner::add(hidden_layer::maxpool_layer& layer)
+{
+	add_buffer(planner_helper::collect(layer, &hidden_layer::maxpool_layer::get_map), buffer_kind::output);
+	add_buffer(planner_helper::collect(layer, &hidden_layer::maxpool_layer::get_gradient), buffer_kind::mask);
+	updated.push_back(false);
+	num_layers++;
+}
+
+void nn::memory_planner::add(hidden_layer::conv2_linear_adapter_layer& layer)
+{
+	// out_vector is an nn::vector, which can't view external memory: only the gradients are planned
+	add_buffer(planner_helper::collect(layer, &hidden_layer::conv2_linear_adapter_layer::get_gradient), buffer_kind::gradient);
+	updated.push_back(false);
+	num_layers++;
+}
+
+bool nn::memory_planner::is_scratch(const buffer& b) const
+{
+	return plan_mode == mode::inference && b.kind != buffer_kind::output;
+}
+
+void nn::memory_planner::compute_lifetimes()
+{
+	const size_t backward_end = 2 * num_layers - 1; // backward step of layer i is backward_end - i
+	const size_t update_step = 2 * num_layers;
+
+	for (auto& b : buffers)
+	{
+		if (is_scratch(b))
+			continue;
+
+		if (plan_mode == mode::inference)
+		{
+			// read by the next layer's forward, or by the caller after the last step
+			b.first = b.layer;
+			b.last = b.layer + 1;
+		}
+		else if (b.kind == buffer_kind::gradient)
+		{
+			// written by our own backward, read by the backward of the layer before, and by our update
+			b.first = backward_end - b.layer;
+			b.last = updated[b.layer] ? update_step : backward_end - b.layer + 1;
+		}
+		else
+		{
+			// maps the next layer updates its weights from, and the last layer's output, outlive the backward pass
+			const bool read_by_update = b.kind == buffer_kind::output && (b.layer + 1 == num_layers || updated[b.layer + 1]);
+
+			b.first = b.layer;
+			b.last = read_by_update ? update_step : backward_end - b.layer;
+		}
+	}
+}
+
+size_t nn::memory_planner::assign_offsets()
+{
+	std::vector<size_t> order;
+	for (size_t i = 0; i < buffers.size(); i++)
+		if (!is_scratch(buffers[i]))
+			order.push_back(i);
+
+	// greedy: largest buffers first, each at the lowest offset free during its whole lifetime
+	std::sort(order.begin(), order.end(), [this](size_t a, size_t b)
+		{
+			if (buffers[a].size != buffers[b].size)
+				return buffers[a].size > buffers[b].size;
+			return buffers[a].first < buffers[b].first;
+		});
+
+	std::vector<const buffer*> placed, live;
+	size_t end = 0;
+
+	for (size_t i : order)
+	{
+		buffer& b = buffers[i];
+
+		live.clear();
+		for (const buffer* p : placed)
+			if (p->first <= b.last && b.first <= p->last)
+				live.push_back(p);
+
+		std::sort(live.begin(), live.end(), [](const buffer* x, const buffer* y) { return x->offset < y->offset; });
+
+		size_t offset = 0;
+		for (const buffer* p : live)
+		{
+			if (offset + b.size <= p->offset)
+				break; // fits in the gap before p
+			offset = std::max(offset, p->offset + p->size);
+		}
+
+		b.offset = offset;
+		end = std::max(end, offset + b.size);
+		placed.push_back(&b);
+	}
+
+	return end;
+}
+
+void nn::memory_planner::bind()
+{
+	if (arena)
+		throw logic_exception("planner is already bound", __FUNCTION__, __LINE__);
+	if (num_layers == 0)
+		throw logic_exception("no layers registered", __FUNCTION__, __LINE__);
+
+	compute_lifetimes();
+	arena_floats = assign_offsets();
+
+	// unread buffers share one region after the planned ones
+	size_t scratch_floats = 0;
+	for (auto& b : buffers)
+	{
+		if (!is_scratch(b))
+			continue;
+
+		b.offset = arena_floats;
+		scratch_floats = std::max(scratch_floats, b.size);
+	}
+	arena_floats += scratch_floats;
+
+	arena = math::alloc_buffer(arena_floats);
+	memset(arena, 0, sizeof(float) * arena_floats);
+
+	for (auto& b : buffers)
+	{
+		float* ptr = arena + b.offset;
+		for (matrix* m : b.matrices)
+		{
+			const size_t stride = m->stride();
+			m->rebind(ptr, stride);
+			ptr += math::row_stride(stride * m->height());
+		}
+	}
+}
+
+size_t nn::memory_planner::arena_size() const
+{
+	return arena_floats;
+}
+
+size_t nn::memory_planner::unplanned_size() const
+{
+	return unplanned_floats;
+}
+
+nn::memory_planner::mode nn::memory_planner::get_mode() const
+{
+	return plan_mode;
+}
@@ -0,0 +1,88 @@
+// FILENAME: nn-planner.h
+// Static activation memory planner for chains of conv-related layers
+// Buffer lifetimes come from the layer order, buffers that are never live at the same time share memory in one arena
+
+#ifndef NN_PLANNER_H
+#define NN_PLANNER_H
+
+#include "nn-layer.h"
+
+#include <vector>
+
+namespace nn
+{
+	/*
+	TIMELINE: with L registered layers, layer i runs forward at step i and backward at step 2L-1-i,
+	weight updates run as a separate pass after the whole backward pass, at step 2L.
+
+	inference: a map is live from its layer until the next layer has read it, only about two are live at once.
+	           gradients and pooling masks are never read, they all alias one throwaway region
+	training:  each layer fills its own gradient in its own backward (from the layer after it), the layer before
+	           reads it in the next backward step. maps and pooling masks are kept until the backward step of their layer.
+	           what the update pass reads stays live through it: the gradients of conv2 layers and the maps they read
+	*/
+
+	class memory_planner
+	{
+	public:
+		enum class mode
+		{
+			inference,
+			training
+		};
+
+	private:
+		enum class buffer_kind
+		{
+			output, // maps read by the next layer
+			mask, // forward-time values only read by backward (maxpool masks)
+			gradient
+		};
+
+		struct buffer
+		{
+			std::vector<matrix*> matrices; // placed back to back, each aligned
+			buffer_kind kind;
+			size_t layer; // registration index
+			size_t size; // floats, including alignment padding
+			size_t first = 0, last = 0; // live steps, inclusive
+			size_t offset = 0;
+		};
+
+		const mode plan_mode;
+		std::vector<buffer> buffers;
+		size_t num_layers = 0;
+		std::vector<bool> updated; // per registered layer: has weights read by the update pass (conv2)
+		size_t unplanned_floats = 0;
+
+		float* arena = nullptr;
+		size_t arena_floats = 0;
+
+		void add_buffer(std::vector<matrix*> matrices, buffer_kind kind);
+		bool is_scratch(const buffer& b) const; // never read in this mode
+		void compute_lifetimes();
+		size_t assign_offsets(); // returns the end of the planned region
+
+	public:
+		memory_planner(mode m);
+		~memory_planner(); // releases the arena, layers bound to it must not be used afterwards
+
+		memory_planner(const memory_planner&) = delete;
+		memory_planner& operator =(const memory_planner&) = delete;
+
+		// register layers in forward order, one step each. the adapter's output vector stays owned by the layer
+		void add(hidden_layer::conv2_layer& layer);
+		void add(hidden_layer::relu_layer& layer);
+		void add(hidden_layer::maxpool_layer& layer);
+		void add(hidden_layer::conv2_linear_adapter_layer& layer);
+
+		// plan, allocate the arena and rebind every registered matrix into it. values are not preserved
+		void bind();
+
+		size_t arena_size() const; // floats, valid after bind()
+		size_t unplanned_size() const; // floats the registered buffers take when every layer owns its own
+		mode get_mode() const;
+	};
+}
+
+#endif
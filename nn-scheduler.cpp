@@ -0,0 +1,128 @@
+#include "nn-scheduler.h"
+#include "nn-exception.h"
+
+#include <cstring>
+#include <algorithm>
+
+nn::batch_scheduler::batch_scheduler(const inference_engine& engine, options opts) :engine(engine), opts(opts)
+{
+	if (opts.max_batch == 0 || opts.num_workers == 0)
+		throw logic_exception("batch size and worker count should be positive", __FUNCTION__, __LINE__);
+	if (engine.input_size() == 0)
+		throw logic_exception("engine has no layers", __FUNCTION__, __LINE__);
+
+	for (size_t i = 0; i < opts.num_workers; i++)
+		workers.emplace_back(&batch_scheduler::worker_loop, this);
+}
+
+nn::batch_scheduler::~batch_scheduler()
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+	}
+	changed.notify_all();
+
+	for (auto& t : workers)
+		t.join();
+}
+
+void nn::batch_scheduler::worker_loop()
+{
+	const size_t input_size = engine.input_size(), output_size = engine.output_size();
+
+	// per-worker buffers, sized once for the largest batch
+	std::vector<float> inputs(opts.max_batch * input_size), outputs(opts.max_batch * output_size);
+	std::vector<request> taken;
+	taken.reserve(opts.max_batch);
+
+	std::unique_lock<std::mutex> guard(lock);
+
+	while (true)
+	{
+		changed.wait(guard, [this]() { return stopping || !queue.empty(); });
+
+		if (queue.empty())
+			return; // stopping, everything answered
+
+		// batching window, counted from the arrival of the oldest request
+		const clock::time_point deadline = queue.front().arrival + opts.max_delay;
+		changed.wait_until(guard, deadline, [this]() { return stopping || queue.size() >= opts.max_batch; });
+
+		const size_t n = std::min(queue.size(), opts.max_batch);
+		if (n == 0)
+			continue; // another worker took them
+
+		for (size_t i = 0; i < n; i++)
+		{
+			taken.push_back(std::move(queue.front()));
+			queue.pop_front();
+		}
+
+		guard.unlock();
+
+		for (size_t i = 0; i < n; i++)
+			memcpy(inputs.data() + i * input_size, taken[i].input.data(), sizeof(float) * input_size);
+
+		try
+		{
+			engine.predict(inputs.data(), n, outputs.data());
+
+			for (size_t i = 0; i < n; i++)
+			{
+				vector result(output_size);
+				memcpy(result.data(), outputs.data() + i * output_size, sizeof(float) * output_size);
+				taken[i].result.set_value(std::move(result));
+			}
+		}
+		catch (...)
+		{
+			for (size_t i = 0; i < n; i++)
+				taken[i].result.set_exception(std::current_exception());
+		}
+
+		taken.clear();
+		num_requests += n;
+		num_batches++;
+
+		guard.lock();
+	}
+}
+
+std::future<nn::vector> nn::batch_scheduler::submit(const float* input)
+{
+	request r;
+	r.input = vector(engine.input_size());
+	memcpy(r.input.data(), input, sizeof(float) * engine.input_size());
+	r.arrival = clock::now();
+
+	std::future<vector> result = r.result.get_future();
+
+	{
+		std::lock_guard<std::mutex> guard(lock);
+
+		if (stopping)
+			throw logic_exception("scheduler is shutting down", __FUNCTION__, __LINE__);
+
+		queue.push_back(std::move(r));
+
+		// wake a worker for a new window, or to run a full batch early
+		if (queue.size() == 1 || queue.size() >= opts.max_batch)
+			changed.notify_all();
+	}
+
+	return result;
+}
+
+std::future<nn::vector> nn::batch_scheduler::submit(const vector& input)
+{
+	if (input.size() != engine.input_size())
+		throw logic_exception("input size mismatch", __FUNCTION__, __LINE__);
+
+	return submit(input.data());
+}
+
+nn::batch_scheduler::stats nn::batch_scheduler::get_stats() const
+{
+	return { num_requests.load(), num_batches.load() };
+}
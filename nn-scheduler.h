@@ -0,0 +1,76 @@
+// FILENAME: nn-scheduler.h
+// Dynamic request batching in front of an inference_engine
+// Single-sample requests are queued and run as one batched forward pass once enough arrive or the oldest waited long enough
+
+#ifndef NN_SCHEDULER_H
+#define NN_SCHEDULER_H
+
+#include "nn-inference.h"
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <chrono>
+#include <atomic>
+
+namespace nn
+{
+	class batch_scheduler
+	{
+	public:
+		struct options
+		{
+			size_t max_batch = 32; // run as soon as this many requests are waiting
+			std::chrono::microseconds max_delay = std::chrono::microseconds(1000); // or when the oldest request waited this long
+			size_t num_workers = 1; // threads running batches, each with its own buffers
+		};
+
+		struct stats
+		{
+			size_t requests; // completed
+			size_t batches; // forward passes, requests / batches is the average batch size
+		};
+
+	private:
+		using clock = std::chrono::steady_clock;
+
+		struct request
+		{
+			vector input;
+			std::promise<vector> result;
+			clock::time_point arrival;
+		};
+
+		const inference_engine& engine;
+		const options opts;
+
+		std::deque<request> queue;
+		bool stopping = false;
+
+		std::mutex lock;
+		std::condition_variable changed;
+		std::vector<std::thread> workers;
+
+		std::atomic<size_t> num_requests{ 0 }, num_batches{ 0 };
+
+		void worker_loop();
+
+	public:
+		batch_scheduler(const inference_engine& engine, options opts); // engine must outlive the scheduler
+		~batch_scheduler(); // runs every queued request first
+
+		batch_scheduler(const batch_scheduler&) = delete;
+		batch_scheduler& operator =(const batch_scheduler&) = delete;
+
+		// queue one sample (input_size() floats, copied), the future receives its output_size() outputs or the exception
+		std::future<vector> submit(const float* input);
+		std::future<vector> submit(const vector& input);
+
+		stats get_stats() const;
+	};
+}
+
+#endif
@@ -0,0 +1,1001 @@
+#include "nn-simd.h"
+#include "nn-exception.h"
+
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define NN_SIMD_X86
+#endif
+
+#ifdef NN_SIMD_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#define NN_TARGET(x) // msvc allows any intrinsic without per-function flags
+#else
+#include <cpuid.h>
+#include <immintrin.h>
+#define NN_TARGET(x) __attribute__((target(x)))
+#endif
+#endif
+
+//== vector exp constants (cephes expf): exp(x) = 2^n * p(r), x = n * ln2 + r, |r| <= ln2 / 2
+
+namespace exp_const
+{
+	constexpr float max_x = 88.3762626647949f; // larger overflows
+	constexpr float min_x = -87.3365447505531f; // smaller is denormal
+	constexpr float log2e = 1.44269504088896341f;
+	constexpr float ln2_hi = 0.693359375f; // ln2 split in two, so n * ln2_hi is exact
+	constexpr float ln2_lo = -2.12194440e-4f;
+	constexpr float p0 = 1.9875691500e-4f, p1 = 1.3981999507e-3f, p2 = 8.3334519073e-3f;
+	constexpr float p3 = 4.1665795894e-2f, p4 = 1.6666665459e-1f, p5 = 5.0000001201e-1f;
+}
+
+//== scalar kernels, local
+
+namespace simd_scalar
+{
+	float dot(const float* left, const float* right, size_t num)
+	{
+		// 4 independent accumulators, so the loop isn't bound by add latency
+		float acc[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		size_t i = 0;
+
+		for (; i + 4 <= num; i += 4)
+		{
+			acc[0] += left[i] * right[i];
+			acc[1] += left[i + 1] * right[i + 1];
+			acc[2] += left[i + 2] * right[i + 2];
+			acc[3] += left[i + 3] * right[i + 3];
+		}
+
+		for (; i < num; i++)
+			acc[0] += left[i] * right[i];
+
+		return (acc[0] + acc[1]) + (acc[2] + acc[3]);
+	}
+
+	void add_scalar(float* array, float addition, size_t num)
+	{
+		for (size_t i = 0; i < num; i++)
+			array[i] += addition;
+	}
+
+	void add(float* left, const float* right, size_t num)
+	{
+		for (size_t i = 0; i < num; i++)
+			left[i] += right[i];
+	}
+
+	void axpy(float* y, float alpha, const float* x, size_t num)
+	{
+		for (size_t i = 0; i < num; i++)
+			y[i] += alpha * x[i];
+	}
+
+	void relu(const float* in, float* out, float slope, size_t num)
+	{
+		for (size_t i = 0; i < num; i++)
+			out[i] = in[i] > 0 ? in[i] : slope * in[i];
+	}
+
+	void relu_backward(const float* in, float* out, float slope, size_t num)
+	{
+		for (size_t i = 0; i < num; i++)
+			out[i] = in[i] > 0 ? 1.0f : slope;
+	}
+
+	void sigmoid(const float* in, float* out, size_t num)
+	{
+		for (size_t i = 0; i < num; i++)
+			out[i] = 1.0f / (1.0f + expf(-in[i]));
+	}
+
+	void normalize_u8(const unsigned char* in, float* out, size_t num)
+	{
+		for (size_t i = 0; i < num; i++)
+			out[i] = in[i] / 255.0f;
+	}
+
+	void reverse(const float* in, float* out, size_t num)
+	{
+		for (size_t i = 0; i < num; i++)
+			out[i] = in[num - 1 - i];
+	}
+
+	void scale_clamp(float* data, float scale, float low, float high, size_t num)
+	{
+		for (size_t i = 0; i < num; i++)
+			data[i] = std::min(std::max(data[i] * scale, low), high);
+	}
+
+	// fixed trip counts, compilers vectorize the inner loop
+	void gemm_micro(size_t kc, const float* a, const float* b, float* c, size_t ldc, float alpha)
+	{
+		constexpr size_t mr = nn::simd::gemm_mr, nr = nn::simd::gemm_nr;
+		float acc[mr][nr] = {};
+
+		for (size_t p = 0; p < kc; p++)
+		{
+			for (size_t i = 0; i < mr; i++)
+				for (size_t j = 0; j < nr; j++)
+					acc[i][j] += a[i] * b[j];
+
+			a += mr;
+			b += nr;
+		}
+
+		for (size_t i = 0; i < mr; i++)
+			for (size_t j = 0; j < nr; j++)
+				c[i * ldc + j] += alpha * acc[i][j];
+	}
+
+	// fused element-wise product and output transform, the product is never stored
+	void winograd_output(const float* v, const float* u, float* y, size_t num)
+	{
+		const float* v0 = v; const float* v1 = v + num; const float* v2 = v + 2 * num; const float* v3 = v + 3 * num;
+		const float* v4 = v + 4 * num; const float* v5 = v + 5 * num; const float* v6 = v + 6 * num; const float* v7 = v + 7 * num;
+		const float* v8 = v + 8 * num; const float* v9 = v + 9 * num; const float* v10 = v + 10 * num; const float* v11 = v + 11 * num;
+		const float* v12 = v + 12 * num; const float* v13 = v + 13 * num; const float* v14 = v + 14 * num; const float* v15 = v + 15 * num;
+		float* y0 = y; float* y1 = y + num; float* y2 = y + 2 * num; float* y3 = y + 3 * num;
+
+		const float u0 = u[0], u1 = u[1], u2 = u[2], u3 = u[3], u4 = u[4], u5 = u[5], u6 = u[6], u7 = u[7];
+		const float u8 = u[8], u9 = u[9], u10 = u[10], u11 = u[11], u12 = u[12], u13 = u[13], u14 = u[14], u15 = u[15];
+
+		for (size_t t = 0; t < num; t++)
+		{
+			float m0 = u0 * v0[t], m1 = u1 * v1[t], m2 = u2 * v2[t], m3 = u3 * v3[t];
+			float m4 = u4 * v4[t], m5 = u5 * v5[t], m6 = u6 * v6[t], m7 = u7 * v7[t];
+			float m8 = u8 * v8[t], m9 = u9 * v9[t], m10 = u10 * v10[t], m11 = u11 * v11[t];
+			float m12 = u12 * v12[t], m13 = u13 * v13[t], m14 = u14 * v14[t], m15 = u15 * v15[t];
+
+			// s = A^T * M, 2x4
+			float s0 = m0 + m4 + m8, s1 = m1 + m5 + m9, s2 = m2 + m6 + m10, s3 = m3 + m7 + m11;
+			float s4 = m4 - m8 - m12, s5 = m5 - m9 - m13, s6 = m6 - m10 - m14, s7 = m7 - m11 - m15;
+
+			// Y = s * A, 2x2
+			y0[t] = s0 + s1 + s2;
+			y1[t] = s1 - s2 - s3;
+			y2[t] = s4 + s5 + s6;
+			y3[t] = s5 - s6 - s7;
+		}
+	}
+}
+
+#ifdef NN_SIMD_X86
+
+//== sse2 kernels, local
+
+namespace simd_sse2
+{
+	NN_TARGET("sse2") float dot(const float* left, const float* right, size_t num)
+	{
+		__m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+		size_t i = 0;
+
+		for (; i + 8 <= num; i += 8)
+		{
+			acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(left + i), _mm_loadu_ps(right + i)));
+			acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(left + i + 4), _mm_loadu_ps(right + i + 4)));
+		}
+
+		for (; i + 4 <= num; i += 4)
+			acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(left + i), _mm_loadu_ps(right + i)));
+
+		// horizontal sum
+		acc0 = _mm_add_ps(acc0, acc1);
+		acc0 = _mm_add_ps(acc0, _mm_movehl_ps(acc0, acc0));
+		acc0 = _mm_add_ss(acc0, _mm_shuffle_ps(acc0, acc0, 1));
+		float result = _mm_cvtss_f32(acc0);
+
+		for (; i < num; i++)
+			result += left[i] * right[i];
+
+		return result;
+	}
+
+	NN_TARGET("sse2") void add_scalar(float* array, float addition, size_t num)
+	{
+		const __m128 add = _mm_set1_ps(addition);
+		size_t i = 0;
+
+		for (; i + 4 <= num; i += 4)
+			_mm_storeu_ps(array + i, _mm_add_ps(_mm_loadu_ps(array + i), add));
+
+		for (; i < num; i++)
+			array[i] += addition;
+	}
+
+	NN_TARGET("sse2") void add(float* left, const float* right, size_t num)
+	{
+		size_t i = 0;
+
+		for (; i + 4 <= num; i += 4)
+			_mm_storeu_ps(left + i, _mm_add_ps(_mm_loadu_ps(left + i), _mm_loadu_ps(right + i)));
+
+		for (; i < num; i++)
+			left[i] += right[i];
+	}
+
+	NN_TARGET("sse2") void axpy(float* y, float alpha, const float* x, size_t num)
+	{
+		const __m128 a = _mm_set1_ps(alpha);
+		size_t i = 0;
+
+		for (; i + 4 <= num; i += 4)
+			_mm_storeu_ps(y + i, _mm_add_ps(_mm_loadu_ps(y + i), _mm_mul_ps(a, _mm_loadu_ps(x + i))));
+
+		for (; i < num; i++)
+			y[i] += alpha * x[i];
+	}
+
+	NN_TARGET("sse2") void relu(const float* in, float* out, float slope, size_t num)
+	{
+		const __m128 s = _mm_set1_ps(slope), zero = _mm_setzero_ps();
+		size_t i = 0;
+
+		for (; i + 4 <= num; i += 4)
+		{
+			__m128 x = _mm_loadu_ps(in + i);
+			__m128 positive = _mm_cmpgt_ps(x, zero);
+			_mm_storeu_ps(out + i, _mm_or_ps(_mm_and_ps(positive, x), _mm_andnot_ps(positive, _mm_mul_ps(s, x))));
+		}
+
+		simd_scalar::relu(in + i, out + i, slope, num - i);
+	}
+
+	NN_TARGET("sse2") void relu_backward(const float* in, float* out, float slope, size_t num)
+	{
+		const __m128 s = _mm_set1_ps(slope), one = _mm_set1_ps(1.0f), zero = _mm_setzero_ps();
+		size_t i = 0;
+
+		for (; i + 4 <= num; i += 4)
+		{
+			__m128 positive = _mm_cmpgt_ps(_mm_loadu_ps(in + i), zero);
+			_mm_storeu_ps(out + i, _mm_or_ps(_mm_and_ps(positive, one), _mm_andnot_ps(positive, s)));
+		}
+
+		simd_scalar::relu_backward(in + i, out + i, slope, num - i);
+	}
+
+	NN_TARGET("sse2") inline __m128 exp(__m128 x)
+	{
+		using namespace exp_const;
+
+		x = _mm_min_ps(_mm_max_ps(x, _mm_set1_ps(min_x)), _mm_set1_ps(max_x));
+
+		__m128i n = _mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps(log2e))); // round to nearest
+		__m128 fn = _mm_cvtepi32_ps(n);
+		__m128 r = _mm_sub_ps(_mm_sub_ps(x, _mm_mul_ps(fn, _mm_set1_ps(ln2_hi))), _mm_mul_ps(fn, _mm_set1_ps(ln2_lo)));
+
+		__m128 p = _mm_set1_ps(p0);
+		p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(p1));
+		p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(p2));
+		p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(p3));
+		p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(p4));
+		p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(p5));
+		p = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(p, r), r), r), _mm_set1_ps(1.0f));
+
+		__m128 scale = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(n, _mm_set1_epi32(127)), 23));
+		return _mm_mul_ps(p, scale);
+	}
+
+	NN_TARGET("sse2") void sigmoid(const float* in, float* out, size_t num)
+	{
+		const __m128 one = _mm_set1_ps(1.0f);
+		size_t i = 0;
+
+		for (; i + 4 <= num; i += 4)
+		{
+			__m128 e = exp(_mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(in + i)));
+			_mm_storeu_ps(out + i, _mm_div_ps(one, _mm_add_ps(one, e)));
+		}
+
+		simd_scalar::sigmoid(in + i, out + i, num - i);
+	}
+
+	// division (not * 1/255) so results match the scalar loaders bit for bit
+	NN_TARGET("sse2") void normalize_u8(const unsigned char* in, float* out, size_t num)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		const __m128 divisor = _mm_set1_ps(255.0f);
+		size_t i = 0;
+
+		for (; i + 16 <= num; i += 16)
+		{
+			__m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+			__m128i lo = _mm_unpacklo_epi8(bytes, zero), hi = _mm_unpackhi_epi8(bytes, zero);
+
+			_mm_storeu_ps(out + i, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)), divisor));
+			_mm_storeu_ps(out + i + 4, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)), divisor));
+			_mm_storeu_ps(out + i + 8, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)), divisor));
+			_mm_storeu_ps(out + i + 12, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)), divisor));
+		}
+
+		simd_scalar::normalize_u8(in + i, out + i, num - i);
+	}
+
+	// blocks of 4 from the end of in, each reversed in register
+	NN_TARGET("sse2") void reverse(const float* in, float* out, size_t num)
+	{
+		size_t i = 0;
+
+		for (; i + 4 <= num; i += 4)
+		{
+			__m128 x = _mm_loadu_ps(in + num - i - 4);
+			_mm_storeu_ps(out + i, _mm_shuffle_ps(x, x, _MM_SHUFFLE(0, 1, 2, 3)));
+		}
+
+		for (; i < num; i++)
+			out[i] = in[num - 1 - i];
+	}
+
+	NN_TARGET("sse2") void scale_clamp(float* data, float scale, float low, float high, size_t num)
+	{
+		const __m128 s = _mm_set1_ps(scale), lo = _mm_set1_ps(low), hi = _mm_set1_ps(high);
+		size_t i = 0;
+
+		for (; i + 4 <= num; i += 4)
+			_mm_storeu_ps(data + i, _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(data + i), s), lo), hi));
+
+		simd_scalar::scale_clamp(data + i, scale, low, high, num - i);
+	}
+
+	// NOTE: a 6x16 tile needs 24 xmm accumulators, more than sse2 has; sse2 uses the scalar micro-kernel
+}
+
+//== avx2 kernels, local
+
+namespace simd_avx2
+{
+	NN_TARGET("avx2,fma") float dot(const float* left, const float* right, size_t num)
+	{
+		__m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+		__m256 acc2 = _mm256_setzero_ps(), acc3 = _mm256_setzero_ps();
+		size_t i = 0;
+
+		for (; i + 32 <= num; i += 32)
+		{
+			acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(left + i), _mm256_loadu_ps(right + i), acc0);
+			acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(left + i + 8), _mm256_loadu_ps(right + i + 8), acc1);
+			acc2 = _mm256_fmadd_ps(_mm256_loadu_ps(left + i + 16), _mm256_loadu_ps(right + i + 16), acc2);
+			acc3 = _mm256_fmadd_ps(_mm256_loadu_ps(left + i + 24), _mm256_loadu_ps(right + i + 24), acc3);
+		}
+
+		for (; i + 8 <= num; i += 8)
+			acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(left + i), _mm256_loadu_ps(right + i), acc0);
+
+		// horizontal sum
+		__m256 acc = _mm256_add_ps(_mm256_add_ps(acc0, acc1), _mm256_add_ps(acc2, acc3));
+		__m128 sum = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+		sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+		sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+		float result = _mm_cvtss_f32(sum);
+
+		for (; i < num; i++)
+			result += left[i] * right[i];
+
+		return result;
+	}
+
+	NN_TARGET("avx2,fma") void add_scalar(float* array, float addition, size_t num)
+	{
+		const __m256 add = _mm256_set1_ps(addition);
+		size_t i = 0;
+
+		for (; i + 8 <= num; i += 8)
+			_mm256_storeu_ps(array + i, _mm256_add_ps(_mm256_loadu_ps(array + i), add));
+
+		for (; i < num; i++)
+			array[i] += addition;
+	}
+
+	NN_TARGET("avx2,fma") void add(float* left, const float* right, size_t num)
+	{
+		size_t i = 0;
+
+		for (; i + 8 <= num; i += 8)
+			_mm256_storeu_ps(left + i, _mm256_add_ps(_mm256_loadu_ps(left + i), _mm256_loadu_ps(right + i)));
+
+		for (; i < num; i++)
+			left[i] += right[i];
+	}
+
+	NN_TARGET("avx2,fma") void axpy(float* y, float alpha, const float* x, size_t num)
+	{
+		const __m256 a = _mm256_set1_ps(alpha);
+		size_t i = 0;
+
+		for (; i + 8 <= num; i += 8)
+			_mm256_storeu_ps(y + i, _mm256_fmadd_ps(a, _mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i)));
+
+		for (; i < num; i++)
+			y[i] += alpha * x[i];
+	}
+
+	NN_TARGET("avx2,fma") void relu(const float* in, float* out, float slope, size_t num)
+	{
+		const __m256 s = _mm256_set1_ps(slope), zero = _mm256_setzero_ps();
+		size_t i = 0;
+
+		for (; i + 8 <= num; i += 8)
+		{
+			__m256 x = _mm256_loadu_ps(in + i);
+			_mm256_storeu_ps(out + i, _mm256_blendv_ps(_mm256_mul_ps(s, x), x, _mm256_cmp_ps(x, zero, _CMP_GT_OQ)));
+		}
+
+		simd_scalar::relu(in + i, out + i, slope, num - i);
+	}
+
+	NN_TARGET("avx2,fma") void relu_backward(const float* in, float* out, float slope, size_t num)
+	{
+		const __m256 s = _mm256_set1_ps(slope), one = _mm256_set1_ps(1.0f), zero = _mm256_setzero_ps();
+		size_t i = 0;
+
+		for (; i + 8 <= num; i += 8)
+			_mm256_storeu_ps(out + i, _mm256_blendv_ps(s, one, _mm256_cmp_ps(_mm256_loadu_ps(in + i), zero, _CMP_GT_OQ)));
+
+		simd_scalar::relu_backward(in + i, out + i, slope, num - i);
+	}
+
+	NN_TARGET("avx2,fma") inline __m256 exp(__m256 x)
+	{
+		using namespace exp_const;
+
+		x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(min_x)), _mm256_set1_ps(max_x));
+
+		__m256 fn = _mm256_round_ps(_mm256_mul_ps(x, _mm256_set1_ps(log2e)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+		__m256 r = _mm256_fnmadd_ps(fn, _mm256_set1_ps(ln2_hi), x);
+		r = _mm256_fnmadd_ps(fn, _mm256_set1_ps(ln2_lo), r);
+
+		__m256 p = _mm256_set1_ps(p0);
+		p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(p1));
+		p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(p2));
+		p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(p3));
+		p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(p4));
+		p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(p5));
+		p = _mm256_fmadd_ps(_mm256_mul_ps(p, r), r, _mm256_add_ps(r, _mm256_set1_ps(1.0f)));
+
+		__m256i n = _mm256_cvtps_epi32(fn);
+		__m256 scale = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(n, _mm256_set1_epi32(127)), 23));
+		return _mm256_mul_ps(p, scale);
+	}
+
+	NN_TARGET("avx2,fma") void sigmoid(const float* in, float* out, size_t num)
+	{
+		const __m256 one = _mm256_set1_ps(1.0f);
+		size_t i = 0;
+
+		for (; i + 8 <= num; i += 8)
+		{
+			__m256 e = exp(_mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(in + i)));
+			_mm256_storeu_ps(out + i, _mm256_div_ps(one, _mm256_add_ps(one, e)));
+		}
+
+		simd_scalar::sigmoid(in + i, out + i, num - i);
+	}
+
+	NN_TARGET("avx2,fma") void normalize_u8(const unsigned char* in, float* out, size_t num)
+	{
+		const __m256 divisor = _mm256_set1_ps(255.0f);
+		size_t i = 0;
+
+		for (; i + 16 <= num; i += 16)
+		{
+			__m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+
+			_mm256_storeu_ps(out + i, _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(bytes)), divisor));
+			_mm256_storeu_ps(out + i + 8, _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_srli_si128(bytes, 8))), divisor));
+		}
+
+		simd_scalar::normalize_u8(in + i, out + i, num - i);
+	}
+
+	NN_TARGET("avx2,fma") void reverse(const float* in, float* out, size_t num)
+	{
+		const __m256i order = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+		size_t i = 0;
+
+		for (; i + 8 <= num; i += 8)
+			_mm256_storeu_ps(out + i, _mm256_permutevar8x32_ps(_mm256_loadu_ps(in + num - i - 8), order));
+
+		for (; i < num; i++)
+			out[i] = in[num - 1 - i];
+	}
+
+	NN_TARGET("avx2,fma") void scale_clamp(float* data, float scale, float low, float high, size_t num)
+	{
+		const __m256 s = _mm256_set1_ps(scale), lo = _mm256_set1_ps(low), hi = _mm256_set1_ps(high);
+		size_t i = 0;
+
+		for (; i + 8 <= num; i += 8)
+			_mm256_storeu_ps(data + i, _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(data + i), s), lo), hi));
+
+		simd_scalar::scale_clamp(data + i, scale, low, high, num - i);
+	}
+
+	// dst[0..16] += alpha * (lo, hi)
+	NN_TARGET("avx2,fma") inline void store_row(float* dst, __m256 alpha, __m256 lo, __m256 hi)
+	{
+		_mm256_storeu_ps(dst, _mm256_fmadd_ps(alpha, lo, _mm256_loadu_ps(dst)));
+		_mm256_storeu_ps(dst + 8, _mm256_fmadd_ps(alpha, hi, _mm256_loadu_ps(dst + 8)));
+	}
+
+	// 6x16 tile: 12 ymm accumulators, 2 loads of B and 6 broadcasts of A per step
+	NN_TARGET("avx2,fma") void gemm_micro(size_t kc, const float* a, const float* b, float* c, size_t ldc, float alpha)
+	{
+		__m256 c00 = _mm256_setzero_ps(), c01 = _mm256_setzero_ps();
+		__m256 c10 = _mm256_setzero_ps(), c11 = _mm256_setzero_ps();
+		__m256 c20 = _mm256_setzero_ps(), c21 = _mm256_setzero_ps();
+		__m256 c30 = _mm256_setzero_ps(), c31 = _mm256_setzero_ps();
+		__m256 c40 = _mm256_setzero_ps(), c41 = _mm256_setzero_ps();
+		__m256 c50 = _mm256_setzero_ps(), c51 = _mm256_setzero_ps();
+
+		for (size_t p = 0; p < kc; p++)
+		{
+			__m256 b0 = _mm256_loadu_ps(b);
+			__m256 b1 = _mm256_loadu_ps(b + 8);
+			__m256 av;
+
+			av = _mm256_broadcast_ss(a + 0); c00 = _mm256_fmadd_ps(av, b0, c00); c01 = _mm256_fmadd_ps(av, b1, c01);
+			av = _mm256_broadcast_ss(a + 1); c10 = _mm256_fmadd_ps(av, b0, c10); c11 = _mm256_fmadd_ps(av, b1, c11);
+			av = _mm256_broadcast_ss(a + 2); c20 = _mm256_fmadd_ps(av, b0, c20); c21 = _mm256_fmadd_ps(av, b1, c21);
+			av = _mm256_broadcast_ss(a + 3); c30 = _mm256_fmadd_ps(av, b0, c30); c31 = _mm256_fmadd_ps(av, b1, c31);
+			av = _mm256_broadcast_ss(a + 4); c40 = _mm256_fmadd_ps(av, b0, c40); c41 = _mm256_fmadd_ps(av, b1, c41);
+			av = _mm256_broadcast_ss(a + 5); c50 = _mm256_fmadd_ps(av, b0, c50); c51 = _mm256_fmadd_ps(av, b1, c51);
+
+			a += 6;
+			b += 16;
+		}
+
+		const __m256 al = _mm256_set1_ps(alpha);
+
+		store_row(c, al, c00, c01);
+		store_row(c + ldc, al, c10, c11);
+		store_row(c + 2 * ldc, al, c20, c21);
+		store_row(c + 3 * ldc, al, c30, c31);
+		store_row(c + 4 * ldc, al, c40, c41);
+		store_row(c + 5 * ldc, al, c50, c51);
+	}
+
+	// 8 tiles per iteration, same arithmetic as the scalar version
+	NN_TARGET("avx2,fma") void winograd_output(const float* v, const float* u, float* y, size_t num)
+	{
+		__m256 uv[16];
+		for (size_t e = 0; e < 16; e++)
+			uv[e] = _mm256_set1_ps(u[e]);
+
+		size_t t = 0;
+		for (; t + 8 <= num; t += 8)
+		{
+			__m256 m[16];
+			for (size_t e = 0; e < 16; e++)
+				m[e] = _mm256_mul_ps(uv[e], _mm256_loadu_ps(v + e * num + t));
+
+			__m256 s0 = _mm256_add_ps(_mm256_add_ps(m[0], m[4]), m[8]);
+			__m256 s1 = _mm256_add_ps(_mm256_add_ps(m[1], m[5]), m[9]);
+			__m256 s2 = _mm256_add_ps(_mm256_add_ps(m[2], m[6]), m[10]);
+			__m256 s3 = _mm256_add_ps(_mm256_add_ps(m[3], m[7]), m[11]);
+			__m256 s4 = _mm256_sub_ps(_mm256_sub_ps(m[4], m[8]), m[12]);
+			__m256 s5 = _mm256_sub_ps(_mm256_sub_ps(m[5], m[9]), m[13]);
+			__m256 s6 = _mm256_sub_ps(_mm256_sub_ps(m[6], m[10]), m[14]);
+			__m256 s7 = _mm256_sub_ps(_mm256_sub_ps(m[7], m[11]), m[15]);
+
+			_mm256_storeu_ps(y + t, _mm256_add_ps(_mm256_add_ps(s0, s1), s2));
+			_mm256_storeu_ps(y + num + t, _mm256_sub_ps(_mm256_sub_ps(s1, s2), s3));
+			_mm256_storeu_ps(y + 2 * num + t, _mm256_add_ps(_mm256_add_ps(s4, s5), s6));
+			_mm256_storeu_ps(y + 3 * num + t, _mm256_sub_ps(_mm256_sub_ps(s5, s6), s7));
+		}
+
+		if (t < num) // tail, shift the rows so the scalar kernel sees the same layout
+		{
+			float tail_v[16 * 8], tail_y[4 * 8];
+			size_t rest = num - t;
+
+			for (size_t e = 0; e < 16; e++)
+				memcpy(tail_v + e * rest, v + e * num + t, sizeof(float) * rest);
+
+			simd_scalar::winograd_output(tail_v, u, tail_y, rest);
+
+			for (size_t r = 0; r < 4; r++)
+				memcpy(y + r * num + t, tail_y + r * rest, sizeof(float) * rest);
+		}
+	}
+}
+
+//== avx512 kernels, local. tails are handled with masked loads instead of scalar loops
+
+namespace simd_avx512
+{
+	NN_TARGET("avx512f") inline __mmask16 tail_mask(size_t remaining)
+	{
+		return remaining >= 16 ? static_cast<__mmask16>(0xFFFF) : static_cast<__mmask16>((1u << remaining) - 1);
+	}
+
+	NN_TARGET("avx512f") float dot(const float* left, const float* right, size_t num)
+	{
+		__m512 acc0 = _mm512_setzero_ps(), acc1 = _mm512_setzero_ps();
+		size_t i = 0;
+
+		for (; i + 32 <= num; i += 32)
+		{
+			acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(left + i), _mm512_loadu_ps(right + i), acc0);
+			acc1 = _mm512_fmadd_ps(_mm512_loadu_ps(left + i + 16), _mm512_loadu_ps(right + i + 16), acc1);
+		}
+
+		for (; i + 16 <= num; i += 16)
+			acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(left + i), _mm512_loadu_ps(right + i), acc0);
+
+		if (i < num)
+		{
+			__mmask16 mask = tail_mask(num - i);
+			acc1 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, left + i), _mm512_maskz_loadu_ps(mask, right + i), acc1);
+		}
+
+		return _mm512_reduce_add_ps(_mm512_add_ps(acc0, acc1));
+	}
+
+	NN_TARGET("avx512f") void add_scalar(float* array, float addition, size_t num)
+	{
+		const __m512 add = _mm512_set1_ps(addition);
+		size_t i = 0;
+
+		for (; i + 16 <= num; i += 16)
+			_mm512_storeu_ps(array + i, _mm512_add_ps(_mm512_loadu_ps(array + i), add));
+
+		if (i < num)
+		{
+			__mmask16 mask = tail_mask(num - i);
+			_mm512_mask_storeu_ps(array + i, mask, _mm512_add_ps(_mm512_maskz_loadu_ps(mask, array + i), add));
+		}
+	}
+
+	NN_TARGET("avx512f") void add(float* left, const float* right, size_t num)
+	{
+		size_t i = 0;
+
+		for (; i + 16 <= num; i += 16)
+			_mm512_storeu_ps(left + i, _mm512_add_ps(_mm512_loadu_ps(left + i), _mm512_loadu_ps(right + i)));
+
+		if (i < num)
+		{
+			__mmask16 mask = tail_mask(num - i);
+			_mm512_mask_storeu_ps(left + i, mask, _mm512_add_ps(_mm512_maskz_loadu_ps(mask, left + i), _mm512_maskz_loadu_ps(mask, right + i)));
+		}
+	}
+
+	NN_TARGET("avx512f") void axpy(float* y, float alpha, const float* x, size_t num)
+	{
+		const __m512 a = _mm512_set1_ps(alpha);
+		size_t i = 0;
+
+		for (; i + 16 <= num; i += 16)
+			_mm512_storeu_ps(y + i, _mm512_fmadd_ps(a, _mm512_loadu_ps(x + i), _mm512_loadu_ps(y + i)));
+
+		if (i < num)
+		{
+			__mmask16 mask = tail_mask(num - i);
+			_mm512_mask_storeu_ps(y + i, mask, _mm512_fmadd_ps(a, _mm512_maskz_loadu_ps(mask, x + i), _mm512_maskz_loadu_ps(mask, y + i)));
+		}
+	}
+
+	NN_TARGET("avx512f") void relu(const float* in, float* out, float slope, size_t num)
+	{
+		const __m512 s = _mm512_set1_ps(slope), zero = _mm512_setzero_ps();
+
+		for (size_t i = 0; i < num; i += 16)
+		{
+			__mmask16 mask = tail_mask(num - i);
+			__m512 x = _mm512_maskz_loadu_ps(mask, in + i);
+			__mmask16 positive = _mm512_cmp_ps_mask(x, zero, _CMP_GT_OQ);
+			_mm512_mask_storeu_ps(out + i, mask, _mm512_mask_blend_ps(positive, _mm512_mul_ps(s, x), x));
+		}
+	}
+
+	NN_TARGET("avx512f") void relu_backward(const float* in, float* out, float slope, size_t num)
+	{
+		const __m512 s = _mm512_set1_ps(slope), one = _mm512_set1_ps(1.0f), zero = _mm512_setzero_ps();
+
+		for (size_t i = 0; i < num; i += 16)
+		{
+			__mmask16 mask = tail_mask(num - i);
+			__mmask16 positive = _mm512_cmp_ps_mask(_mm512_maskz_loadu_ps(mask, in + i), zero, _CMP_GT_OQ);
+			_mm512_mask_storeu_ps(out + i, mask, _mm512_mask_blend_ps(positive, s, one));
+		}
+	}
+
+	NN_TARGET("avx512f") inline __m512 exp(__m512 x)
+	{
+		using namespace exp_const;
+
+		x = _mm512_min_ps(_mm512_max_ps(x, _mm512_set1_ps(min_x)), _mm512_set1_ps(max_x));
+
+		__m512 fn = _mm512_roundscale_ps(_mm512_mul_ps(x, _mm512_set1_ps(log2e)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+		__m512 r = _mm512_fnmadd_ps(fn, _mm512_set1_ps(ln2_hi), x);
+		r = _mm512_fnmadd_ps(fn, _mm512_set1_ps(ln2_lo), r);
+
+		__m512 p = _mm512_set1_ps(p0);
+		p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(p1));
+		p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(p2));
+		p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(p3));
+		p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(p4));
+		p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(p5));
+		p = _mm512_fmadd_ps(_mm512_mul_ps(p, r), r, _mm512_add_ps(r, _mm512_set1_ps(1.0f)));
+
+		return _mm512_scalef_ps(p, fn); // p * 2^n
+	}
+
+	NN_TARGET("avx512f") void sigmoid(const float* in, float* out, size_t num)
+	{
+		const __m512 one = _mm512_set1_ps(1.0f);
+
+		for (size_t i = 0; i < num; i += 16)
+		{
+			__mmask16 mask = tail_mask(num - i);
+			__m512 e = exp(_mm512_sub_ps(_mm512_setzero_ps(), _mm512_maskz_loadu_ps(mask, in + i)));
+			_mm512_mask_storeu_ps(out + i, mask, _mm512_div_ps(one, _mm512_add_ps(one, e)));
+		}
+	}
+
+	NN_TARGET("avx512f") void normalize_u8(const unsigned char* in, float* out, size_t num)
+	{
+		const __m512 divisor = _mm512_set1_ps(255.0f);
+		size_t i = 0;
+
+		for (; i + 16 <= num; i += 16)
+		{
+			__m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+			_mm512_storeu_ps(out + i, _mm512_div_ps(_mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(bytes)), divisor));
+		}
+
+		simd_scalar::normalize_u8(in + i, out + i, num - i); // masked byte loads would need avx512bw
+	}
+
+	NN_TARGET("avx512f") void reverse(const float* in, float* out, size_t num)
+	{
+		const __m512i order = _mm512_setr_epi32(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+		size_t i = 0;
+
+		for (; i + 16 <= num; i += 16)
+			_mm512_storeu_ps(out + i, _mm512_permutexvar_ps(order, _mm512_loadu_ps(in + num - i - 16)));
+
+		for (; i < num; i++)
+			out[i] = in[num - 1 - i];
+	}
+
+	NN_TARGET("avx512f") void scale_clamp(float* data, float scale, float low, float high, size_t num)
+	{
+		const __m512 s = _mm512_set1_ps(scale), lo = _mm512_set1_ps(low), hi = _mm512_set1_ps(high);
+		size_t i = 0;
+
+		for (; i + 16 <= num; i += 16)
+			_mm512_storeu_ps(data + i, _mm512_min_ps(_mm512_max_ps(_mm512_mul_ps(_mm512_loadu_ps(data + i), s), lo), hi));
+
+		if (i < num)
+		{
+			__mmask16 mask = tail_mask(num - i);
+			_mm512_mask_storeu_ps(data + i, mask, _mm512_min_ps(_mm512_max_ps(_mm512_mul_ps(_mm512_maskz_loadu_ps(mask, data + i), s), lo), hi));
+		}
+	}
+
+	// 6x16 tile: one zmm accumulator per row
+	NN_TARGET("avx512f") void gemm_micro(size_t kc, const float* a, const float* b, float* c, size_t ldc, float alpha)
+	{
+		__m512 c0 = _mm512_setzero_ps(), c1 = _mm512_setzero_ps(), c2 = _mm512_setzero_ps();
+		__m512 c3 = _mm512_setzero_ps(), c4 = _mm512_setzero_ps(), c5 = _mm512_setzero_ps();
+
+		for (size_t p = 0; p < kc; p++)
+		{
+			__m512 bv = _mm512_loadu_ps(b);
+
+			c0 = _mm512_fmadd_ps(_mm512_set1_ps(a[0]), bv, c0);
+			c1 = _mm512_fmadd_ps(_mm512_set1_ps(a[1]), bv, c1);
+			c2 = _mm512_fmadd_ps(_mm512_set1_ps(a[2]), bv, c2);
+			c3 = _mm512_fmadd_ps(_mm512_set1_ps(a[3]), bv, c3);
+			c4 = _mm512_fmadd_ps(_mm512_set1_ps(a[4]), bv, c4);
+			c5 = _mm512_fmadd_ps(_mm512_set1_ps(a[5]), bv, c5);
+
+			a += 6;
+			b += 16;
+		}
+
+		const __m512 al = _mm512_set1_ps(alpha);
+		_mm512_storeu_ps(c, _mm512_fmadd_ps(al, c0, _mm512_loadu_ps(c)));
+		_mm512_storeu_ps(c + ldc, _mm512_fmadd_ps(al, c1, _mm512_loadu_ps(c + ldc)));
+		_mm512_storeu_ps(c + 2 * ldc, _mm512_fmadd_ps(al, c2, _mm512_loadu_ps(c + 2 * ldc)));
+		_mm512_storeu_ps(c + 3 * ldc, _mm512_fmadd_ps(al, c3, _mm512_loadu_ps(c + 3 * ldc)));
+		_mm512_storeu_ps(c + 4 * ldc, _mm512_fmadd_ps(al, c4, _mm512_loadu_ps(c + 4 * ldc)));
+		_mm512_storeu_ps(c + 5 * ldc, _mm512_fmadd_ps(al, c5, _mm512_loadu_ps(c + 5 * ldc)));
+	}
+
+	// 16 tiles per iteration, tail handled with masked loads/stores
+	NN_TARGET("avx512f") void winograd_output(const float* v, const float* u, float* y, size_t num)
+	{
+		__m512 uv[16];
+		for (size_t e = 0; e < 16; e++)
+			uv[e] = _mm512_set1_ps(u[e]);
+
+		for (size_t t = 0; t < num; t += 16)
+		{
+			__mmask16 mask = num - t >= 16 ? static_cast<__mmask16>(0xffff) : tail_mask(num - t);
+
+			__m512 m[16];
+			for (size_t e = 0; e < 16; e++)
+				m[e] = _mm512_mul_ps(uv[e], _mm512_maskz_loadu_ps(mask, v + e * num + t));
+
+			__m512 s0 = _mm512_add_ps(_mm512_add_ps(m[0], m[4]), m[8]);
+			__m512 s1 = _mm512_add_ps(_mm512_add_ps(m[1], m[5]), m[9]);
+			__m512 s2 = _mm512_add_ps(_mm512_add_ps(m[2], m[6]), m[10]);
+			__m512 s3 = _mm512_add_ps(_mm512_add_ps(m[3], m[7]), m[11]);
+			__m512 s4 = _mm512_sub_ps(_mm512_sub_ps(m[4], m[8]), m[12]);
+			__m512 s5 = _mm512_sub_ps(_mm512_sub_ps(m[5], m[9]), m[13]);
+			__m512 s6 = _mm512_sub_ps(_mm512_sub_ps(m[6], m[10]), m[14]);
+			__m512 s7 = _mm512_sub_ps(_mm512_sub_ps(m[7], m[11]), m[15]);
+
+			_mm512_mask_storeu_ps(y + t, mask, _mm512_add_ps(_mm512_add_ps(s0, s1), s2));
+			_mm512_mask_storeu_ps(y + num + t, mask, _mm512_sub_ps(_mm512_sub_ps(s1, s2), s3));
+			_mm512_mask_storeu_ps(y + 2 * num + t, mask, _mm512_add_ps(_mm512_add_ps(s4, s5), s6));
+			_mm512_mask_storeu_ps(y + 3 * num + t, mask, _mm512_sub_ps(_mm512_sub_ps(s5, s6), s7));
+		}
+	}
+}
+
+#endif
+
+//== cpu detection & kernel selection, local
+
+namespace simd_helper
+{
+#ifdef NN_SIMD_X86
+	void cpuid(int leaf, int subleaf, unsigned int regs[4])
+	{
+#ifdef _MSC_VER
+		int info[4];
+		__cpuidex(info, leaf, subleaf);
+		for (int i = 0; i < 4; i++)
+			regs[i] = static_cast<unsigned int>(info[i]);
+#else
+		__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+	}
+
+	// XCR0 tells which register states the os saves on context switch
+	unsigned long long xgetbv0()
+	{
+#ifdef _MSC_VER
+		return _xgetbv(0);
+#else
+		unsigned int eax, edx;
+		__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+		return (static_cast<unsigned long long>(edx) << 32) | eax;
+#endif
+	}
+#endif
+
+	nn::simd::isa detect()
+	{
+#ifdef NN_SIMD_X86
+		unsigned int regs[4]; // eax, ebx, ecx, edx
+
+		cpuid(0, 0, regs);
+		unsigned int max_leaf = regs[0];
+
+		cpuid(1, 0, regs);
+		bool sse2 = regs[3] & (1u << 26);
+		bool osxsave = regs[2] & (1u << 27);
+		bool avx = regs[2] & (1u << 28);
+		bool fma = regs[2] & (1u << 12);
+
+		if (!sse2)
+			return nn::simd::isa::scalar;
+		if (!osxsave || !avx || max_leaf < 7)
+			return nn::simd::isa::sse2;
+
+		unsigned long long xcr0 = xgetbv0();
+		bool os_avx = (xcr0 & 0x6) == 0x6; // xmm, ymm
+		bool os_avx512 = (xcr0 & 0xe6) == 0xe6; // xmm, ymm, opmask, zmm
+
+		cpuid(7, 0, regs);
+		bool avx2 = regs[1] & (1u << 5);
+		bool avx512f = regs[1] & (1u << 16);
+
+		if (os_avx512 && avx512f && avx2 && fma)
+			return nn::simd::isa::avx512;
+		if (os_avx && avx2 && fma)
+			return nn::simd::isa::avx2;
+
+		return nn::simd::isa::sse2;
+#else
+		return nn::simd::isa::scalar;
+#endif
+	}
+
+	nn::simd::kernel_table make_table(nn::simd::isa target)
+	{
+		nn::simd::kernel_table table = { simd_scalar::dot, simd_scalar::add_scalar, simd_scalar::add, simd_scalar::axpy, simd_scalar::gemm_micro, simd_scalar::winograd_output, simd_scalar::relu, simd_scalar::relu_backward, simd_scalar::sigmoid, simd_scalar::normalize_u8, simd_scalar::reverse, simd_scalar::scale_clamp };
+
+#ifdef NN_SIMD_X86
+		switch (target)
+		{
+		case nn::simd::isa::avx512:
+			table = { simd_avx512::dot, simd_avx512::add_scalar, simd_avx512::add, simd_avx512::axpy, simd_avx512::gemm_micro, simd_avx512::winograd_output, simd_avx512::relu, simd_avx512::relu_backward, simd_avx512::sigmoid, simd_avx512::normalize_u8, simd_avx512::reverse, simd_avx512::scale_clamp };
+			break;
+		case nn::simd::isa::avx2:
+			table = { simd_avx2::dot, simd_avx2::add_scalar, simd_avx2::add, simd_avx2::axpy, simd_avx2::gemm_micro, simd_avx2::winograd_output, simd_avx2::relu, simd_avx2::relu_backward, simd_avx2::sigmoid, simd_avx2::normalize_u8, simd_avx2::reverse, simd_avx2::scale_clamp };
+			break;
+		case nn::simd::isa::sse2:
+			table = { simd_sse2::dot, simd_sse2::add_scalar, simd_sse2::add, simd_sse2::axpy, simd_scalar::gemm_micro, simd_scalar::winograd_output, simd_sse2::relu, simd_sse2::relu_backward, simd_sse2::sigmoid, simd_sse2::normalize_u8, simd_sse2::reverse, simd_sse2::scale_clamp };
+			break;
+		default:
+			break;
+		}
+#endif
+
+		return table;
+	}
+
+	struct dispatch_state
+	{
+		nn::simd::isa detected, current;
+		nn::simd::kernel_table table;
+
+		dispatch_state()
+		{
+			detected = current = detect();
+			table = make_table(current);
+		}
+	};
+
+	dispatch_state& state()
+	{
+		static dispatch_state instance; // initialized once, on first use
+		return instance;
+	}
+}
+
+nn::simd::isa nn::simd::detect_isa()
+{
+	return simd_helper::state().detected;
+}
+
+nn::simd::isa nn::simd::get_isa()
+{
+	return simd_helper::state().current;
+}
+
+bool nn::simd::isa_supported(isa target)
+{
+	return static_cast<int>(target) <= static_cast<int>(detect_isa());
+}
+
+void nn::simd::force_isa(isa target)
+{
+	if (!isa_supported(target))
+		throw nn::logic_exception(std::format("instruction set {} not supported", isa_name(target)), __FUNCTION__, __LINE__);
+
+	auto& state = simd_helper::state();
+	state.current = target;
+	state.table = simd_helper::make_table(target);
+}
+
+std::string nn::simd::isa_name(isa target)
+{
+	switch (target)
+	{
+	case isa::sse2:
+		return "sse2";
+	case isa::avx2:
+		return "avx2";
+	case isa::avx512:
+		return "avx512";
+	default:
+		return "scalar";
+	}
+}
+
+const nn::simd::kernel_table& nn::simd::kernels()
+{
+	return simd_helper::state().table;
+}
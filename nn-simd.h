@@ -0,0 +1,62 @@
+// FILENAME: nn-simd.h
+// Runtime-dispatched SIMD kernels backing the basic algorithms in nn-math
+// Instruction set is detected once (CPUID) at first use, and can be forced for testing
+
+#ifndef NN_SIMD_H
+#define NN_SIMD_H
+
+#include <string>
+
+namespace nn::simd
+{
+	enum class isa
+	{
+		scalar, // plain c++, always available
+		sse2,
+		avx2, // avx2 + fma
+		avx512 // avx512f
+	};
+
+	// register tile of the gemm micro-kernel: gemm_mr rows * gemm_nr columns of C
+	constexpr size_t gemm_mr = 6;
+	constexpr size_t gemm_nr = 16;
+
+	// function table for the selected instruction set
+	struct kernel_table
+	{
+		float (*dot)(const float* left, const float* right, size_t num);
+		void (*add_scalar)(float* array, float addition, size_t num);
+		void (*add)(float* left, const float* right, size_t num);
+		void (*axpy)(float* y, float alpha, const float* x, size_t num); // y += alpha * x
+
+		// C[gemm_mr*gemm_nr] += alpha * A * B over kc steps
+		// a: packed panel, gemm_mr floats per step; b: packed panel, gemm_nr floats per step; c: row-major with leading dimension ldc
+		void (*gemm_micro)(size_t kc, const float* a, const float* b, float* c, size_t ldc, float alpha);
+
+		// winograd F(2x2,3x3) output stage for num tiles: y = A^T * (u .* v) * A
+		// v: 16 rows of num floats (transformed input), u: 16 floats (transformed kernal), y: 4 rows of num floats
+		void (*winograd_output)(const float* v, const float* u, float* y, size_t num);
+
+		//== activation functions, in and out may alias
+		void (*relu)(const float* in, float* out, float slope, size_t num); // out = x > 0 ? x : slope * x
+		void (*relu_backward)(const float* in, float* out, float slope, size_t num); // out = x > 0 ? 1 : slope
+		void (*sigmoid)(const float* in, float* out, size_t num); // out = 1 / (1 + exp(-x)); vector exp is within ~2 ulp of expf
+
+		//== data conversion
+		void (*normalize_u8)(const unsigned char* in, float* out, size_t num); // out = in / 255
+
+		//== data augmentation
+		void (*reverse)(const float* in, float* out, size_t num); // out[i] = in[num - 1 - i], in and out must not overlap
+		void (*scale_clamp)(float* data, float scale, float low, float high, size_t num); // data = clamp(data * scale, low, high)
+	};
+
+	isa detect_isa(); // best instruction set supported by both cpu and os
+	isa get_isa(); // instruction set currently in use
+	bool isa_supported(isa target);
+	void force_isa(isa target); // switch kernels to target, throws logic_exception if not supported. NOT thread safe
+	std::string isa_name(isa target);
+
+	const kernel_table& kernels(); // kernels of the current instruction set
+}
+
+#endif
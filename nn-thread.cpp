@@ -0,0 +1,144 @@
+#include "nn-thread.h"
+
+//== pool helper functions, local
+
+namespace pool_helper
+{
+	// pool and worker index of the current thread, if it is a pool worker
+	thread_local const nn::thread_pool* current_pool = nullptr;
+	thread_local size_t current_index = static_cast<size_t>(-1);
+}
+
+nn::thread_pool::thread_pool(size_t num_threads)
+{
+	if (num_threads == 0)
+		num_threads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+
+	for (size_t i = 0; i < num_threads; i++)
+		queues.push_back(std::make_unique<worker_queue>());
+
+	for (size_t i = 0; i < num_threads; i++)
+		workers.emplace_back(&thread_pool::worker_loop, this, i);
+}
+
+nn::thread_pool::~thread_pool()
+{
+	{
+		std::lock_guard<std::mutex> guard(sleep_lock);
+		stopping = true;
+	}
+	wake.notify_all();
+
+	for (auto& worker : workers)
+		worker.join();
+}
+
+size_t nn::thread_pool::size() const
+{
+	return workers.size();
+}
+
+void nn::thread_pool::push(std::function<void()> task)
+{
+	// workers push to their own queue (picked up LIFO, cache-warm), other threads spread tasks round-robin
+	size_t target = pool_helper::current_pool == this
+		? pool_helper::current_index
+		: next_queue.fetch_add(1) % queues.size();
+
+	{
+		std::lock_guard<std::mutex> guard(sleep_lock); // pairs with the wait predicate, no lost wake-ups
+		pending++; // counted before it's visible, so pending never drops below the number of queued tasks
+	}
+
+	{
+		std::lock_guard<std::mutex> guard(queues[target]->lock);
+		queues[target]->tasks.push_back(std::move(task));
+	}
+
+	wake.notify_one();
+}
+
+bool nn::thread_pool::pop_task(size_t home, std::function<void()>& task)
+{
+	if (pending.load() == 0)
+		return false;
+
+	// own queue, newest first
+	if (home < queues.size())
+	{
+		std::lock_guard<std::mutex> guard(queues[home]->lock);
+		auto& tasks = queues[home]->tasks;
+
+		if (!tasks.empty())
+		{
+			task = std::move(tasks.back());
+			tasks.pop_back();
+			pending--;
+			return true;
+		}
+	}
+
+	// steal the oldest task of another queue
+	const size_t start = home < queues.size() ? home + 1 : 0;
+	for (size_t offset = 0; offset < queues.size(); offset++)
+	{
+		size_t victim = (start + offset) % queues.size();
+		if (victim == home)
+			continue;
+
+		std::lock_guard<std::mutex> guard(queues[victim]->lock);
+		auto& tasks = queues[victim]->tasks;
+
+		if (!tasks.empty())
+		{
+			task = std::move(tasks.front());
+			tasks.pop_front();
+			pending--;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool nn::thread_pool::run_pending_task()
+{
+	const size_t home = pool_helper::current_pool == this ? pool_helper::current_index : queues.size();
+
+	std::function<void()> task;
+	if (!pop_task(home, task))
+		return false;
+
+	task();
+	return true;
+}
+
+void nn::thread_pool::worker_loop(size_t index)
+{
+	pool_helper::current_pool = this;
+	pool_helper::current_index = index;
+
+	std::function<void()> task;
+
+	while (true)
+	{
+		if (pop_task(index, task))
+		{
+			task();
+			task = nullptr;
+			continue;
+		}
+
+		std::unique_lock<std::mutex> guard(sleep_lock);
+		wake.wait(guard, [this]() { return stopping || pending.load() != 0; });
+
+		if (stopping && pending.load() == 0)
+			return;
+	}
+}
+
+nn::thread_pool& nn::thread_pool::global()
+{
+	static thread_pool pool;
+	return pool;
+}
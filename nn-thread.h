@@ -0,0 +1,138 @@
+// FILENAME: nn-thread.h
+// Work-stealing thread pool, shared by training, data loading and inference
+// Every worker owns a task deque: it pops its own tasks LIFO and steals from the others FIFO
+
+#ifndef NN_THREAD_H
+#define NN_THREAD_H
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <future>
+#include <memory>
+#include <exception>
+#include <algorithm>
+
+namespace nn
+{
+	class thread_pool
+	{
+	private:
+		struct worker_queue
+		{
+			std::mutex lock;
+			std::deque<std::function<void()>> tasks;
+		};
+
+		std::vector<std::unique_ptr<worker_queue>> queues;
+		std::vector<std::thread> workers;
+
+		std::mutex sleep_lock;
+		std::condition_variable wake;
+		std::atomic<size_t> pending{ 0 }; // queued, not yet started
+		std::atomic<size_t> next_queue{ 0 }; // round-robin target for tasks submitted from outside
+		bool stopping = false;
+
+		void push(std::function<void()> task);
+		bool pop_task(size_t home, std::function<void()>& task); // own queue first, then steal
+		void worker_loop(size_t index);
+
+	public:
+		thread_pool(size_t num_threads = 0); // 0: one thread per hardware thread
+		~thread_pool(); // finishes queued tasks, then joins
+
+		thread_pool(const thread_pool&) = delete;
+		thread_pool& operator =(const thread_pool&) = delete;
+
+		size_t size() const; // number of worker threads
+
+		// run a queued task on the calling thread if there is one. lets a waiting thread help instead of blocking
+		bool run_pending_task();
+
+		// queue a task, the future receives its result (or exception)
+		template<typename F>
+		auto submit(F&& func) -> std::future<decltype(func())>
+		{
+			using result_T = decltype(func());
+
+			auto task = std::make_shared<std::packaged_task<result_T()>>(std::forward<F>(func));
+			std::future<result_T> result = task->get_future();
+
+			push([task]() { (*task)(); });
+
+			return result;
+		}
+
+		// func(i) for i in [begin, end), split into chunks of at least grain indices
+		// the calling thread works on chunks too, so it's safe to call from inside a task. rethrows the first exception
+		template<typename F>
+		void parallel_for(size_t begin, size_t end, F&& func, size_t grain = 1)
+		{
+			if (begin >= end)
+				return;
+
+			const size_t count = end - begin;
+			size_t chunks = std::min(count / std::max<size_t>(grain, 1), (size() + 1) * 4);
+			chunks = std::max<size_t>(chunks, 1);
+
+			if (chunks == 1)
+			{
+				for (size_t i = begin; i < end; i++)
+					func(i);
+				return;
+			}
+
+			struct shared_state
+			{
+				std::atomic<size_t> remaining;
+				std::mutex lock;
+				std::exception_ptr error;
+			};
+
+			auto state = std::make_shared<shared_state>();
+			state->remaining = chunks;
+
+			auto run_chunk = [state, &func, begin, count, chunks](size_t chunk)
+				{
+					size_t first = begin + count * chunk / chunks, last = begin + count * (chunk + 1) / chunks;
+
+					try
+					{
+						for (size_t i = first; i < last; i++)
+							func(i);
+					}
+					catch (...)
+					{
+						std::lock_guard<std::mutex> guard(state->lock);
+						if (!state->error)
+							state->error = std::current_exception();
+					}
+
+					state->remaining--;
+				};
+
+			for (size_t chunk = 1; chunk < chunks; chunk++)
+				push([run_chunk, chunk]() { run_chunk(chunk); });
+
+			run_chunk(0);
+
+			// help until every chunk has finished
+			while (state->remaining.load() != 0)
+			{
+				if (!run_pending_task())
+					std::this_thread::yield();
+			}
+
+			if (state->error)
+				std::rethrow_exception(state->error);
+		}
+
+		static thread_pool& global(); // process-wide pool, created on first use
+	};
+}
+
+#endif